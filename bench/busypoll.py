@@ -0,0 +1,142 @@
+'''
+Round trip latency with and without busy polling, over loopback TCP.
+
+    python bench/busypoll.py [--spin=0,0.00005] [--backend=epoll,_epoll]
+        [--connections=1,10] [--busy-poll=usecs] [--duration=seconds]
+
+The echo server runs in a child process, the measured clients in this
+process, both spinning for the same number of seconds before their polls
+block. Every connection has a single 64 byte request in flight. A busy-poll
+of more than 0 also sets SO_BUSY_POLL on every socket, which needs
+CAP_NET_ADMIN and only does something on devices with NAPI, not on loopback.
+
+Each run prints one JSON object per line with throughput and round trip
+percentiles in microseconds.
+'''
+import json
+import os
+import signal
+import sys
+import threading
+import time
+from hdr import Histogram
+from util import raise_nofile
+
+from net.async import tcp
+from net.async.multiplexer import Multiplexer
+from net.async.nonblocking import NonBlocking
+from loopback import backends, connect_all, option
+
+SPINS = ('0', '0.00005')
+BACKENDS = ('epoll', '_epoll')
+CONNECTIONS = (1, 10)
+REQUEST = 'x' * 64
+
+
+def serve(backend, spin, report):
+    raise_nofile(1024)
+    async = Multiplexer(backends()[backend]())
+    server = tcp.Server(('127.0.0.1', 0), backlog=1024, async=async)
+
+    def echo(conn, chunk):
+        conn.send(conn.read())
+
+    server.hook('accept', lambda conn: conn.hook('recv', echo))
+    os.write(report, json.dumps(server.address) + '\n')
+    async.run(spin=spin)
+
+
+class Load(object):
+    def __init__(self):
+        self.latency = Histogram()
+        self.operations = 0
+        self.now = time.time
+
+    def start(self, conn):
+        conn.retain = True
+        conn.hook('recv', self.recv)
+        self.request(conn)
+
+    def request(self, conn):
+        conn.sent = self.now()
+        conn.send(REQUEST)
+
+    def recv(self, conn, chunk):
+        if conn.recv_queued >= len(REQUEST):
+            conn.read(len(REQUEST))
+            self.latency.record((self.now() - conn.sent) * 1e6)
+            self.operations += 1
+            self.request(conn)
+
+
+def run(backend, spin, connections, duration):
+    result = {
+        'backend': backend,
+        'spin': spin,
+        'connections': connections,
+        'busy_poll': NonBlocking.busy_poll,
+    }
+    report, write = os.pipe()
+    pid = os.fork()
+    if pid == 0:
+        os.close(report)
+        try:
+            serve(backend, spin, write)
+        finally:
+            os._exit(0)
+    os.close(write)
+
+    try:
+        address = tuple(json.loads(os.fdopen(report).readline()))
+        async = Multiplexer(backends()[backend]())
+        conns, failed = connect_all(async, address, connections)
+        result['connect_failed'] = failed
+
+        def spun():
+            # The _epoll extension spins on its own and counts it there
+            stats = async.stats()
+            stats = stats.get('_epoll', stats)
+            return stats['spins'], stats['spin_hits']
+
+        before = spun()
+        load = Load()
+        for conn in conns:
+            load.start(conn)
+        timer = threading.Timer(duration, async.stop)
+        start = time.time()
+        timer.start()
+        async.run(spin=spin)
+        elapsed = time.time() - start
+
+        result['seconds'] = round(elapsed, 3)
+        result['operations_per_second'] = round(load.operations / elapsed, 1)
+        result['latency_us'] = load.latency.summary()
+        after = spun()
+        result['spins'] = after[0] - before[0]
+        result['spin_hits'] = after[1] - before[1]
+    finally:
+        os.kill(pid, signal.SIGKILL)
+        os.waitpid(pid, 0)
+
+    for conn in conns:
+        if conn.socket:
+            conn.socket.close()
+    async.poller.close()
+    return result
+
+if __name__ == '__main__':
+    if '--help' in sys.argv:
+        print __doc__
+        sys.exit(0)
+
+    duration = float(option('duration', ['2'])[0])
+    NonBlocking.busy_poll = int(option('busy-poll', ['0'])[0])
+    available = backends()
+    for connections in map(int, option('connections', CONNECTIONS)):
+        for backend in option('backend', BACKENDS):
+            if not backend in available:
+                continue
+            for spin in map(float, option('spin', SPINS)):
+                print json.dumps(run(backend, spin, connections, duration),
+                    sort_keys=True)
+                sys.stdout.flush()
@@ -0,0 +1,116 @@
+'''
+Call overhead of the C extension entry points, in nanoseconds per call. Small
+messages over a socketpair keep the system calls cheap, so argument parsing
+and result building show up.
+
+    python bench/calls.py [--calls=N]
+
+Results are printed as JSON, one object per line.
+'''
+import json
+import socket
+import sys
+import time
+import util
+
+from net.async import _epoll
+from net.family import _bare
+try:
+    from net.family import _ax25
+except ImportError:
+    _ax25 = None
+
+MSG_DONTWAIT = 0x40
+
+
+def measure(name, function, calls):
+    # Best of three, to keep noise from other processes out
+    best = None
+    for attempt in xrange(3):
+        start = time.time()
+        function(calls)
+        elapsed = time.time() - start
+        if best is None or elapsed < best:
+            best = elapsed
+    return {
+        'call': name,
+        'calls': calls,
+        'ns_per_call': round(best / calls * 1e9, 1),
+    }
+
+def main(args):
+    calls = 200000
+    for arg in args:
+        if arg.startswith('--calls='):
+            calls = int(arg.split('=', 1)[1])
+
+    left, right = socket.socketpair()
+    lfd, rfd = left.fileno(), right.fileno()
+    epfd = _epoll.create()
+    _epoll.control(epfd, _epoll.EPOLL_CTL_ADD, rfd, 1)
+
+    def send_recv(n):
+        send, recv = _bare.send, _bare.recv
+        for x in xrange(n):
+            send(lfd, 'x', 1, 0)
+            recv(rfd, 1, 0)
+
+    def send_recv_into(n):
+        send, recv_into = _bare.send, _bare.recv_into
+        buf = bytearray(16)
+        for x in xrange(n):
+            send(lfd, 'x', 1, 0)
+            recv_into(rfd, buf, 1, 0)
+
+    def recv_again(n):
+        recv = _bare.recv
+        for x in xrange(n):
+            try:
+                recv(rfd, 16, MSG_DONTWAIT)
+            except IOError:
+                pass
+
+    def wait_ready(n):
+        wait = _epoll.wait
+        for x in xrange(n):
+            wait(epfd, 0, 64)
+
+    def control(n):
+        ctl, mod = _epoll.control, _epoll.EPOLL_CTL_MOD
+        for x in xrange(n):
+            ctl(epfd, mod, rfd, 1)
+
+    def stats(n):
+        bare_stats = _bare.stats
+        for x in xrange(n):
+            bare_stats()
+
+    results = [
+        measure('_bare.send+recv', send_recv, calls),
+        measure('_bare.send+recv_into', send_recv_into, calls),
+        measure('_bare.recv EAGAIN', recv_again, calls),
+        measure('_epoll.control', control, calls),
+    ]
+    # Leave a byte waiting, so every wait returns an event
+    left.send('x')
+    results.append(measure('_epoll.wait', wait_ready, calls))
+    results.append(measure('_bare.stats', stats, calls))
+
+    if _ax25:
+        address = _ax25.aton('NL0MZ-8')
+        def ntoa(n):
+            function = _ax25.ntoa
+            for x in xrange(n):
+                function(address)
+        def aton(n):
+            function = _ax25.aton
+            for x in xrange(n):
+                function('NL0MZ-8')
+        results.append(measure('_ax25.ntoa', ntoa, calls))
+        results.append(measure('_ax25.aton', aton, calls))
+
+    for result in results:
+        print json.dumps(result, sort_keys=True)
+
+if __name__ == '__main__':
+    main(sys.argv[1:])
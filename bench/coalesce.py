@@ -0,0 +1,135 @@
+'''
+Responses written in several parts, over loopback TCP.
+
+    python bench/coalesce.py [--parts=1,4,16] [--connections=1,100]
+        [--duration=seconds]
+
+The server runs in a child process and answers every 64 byte request with a
+response written by that many send calls, 256 bytes in total. This process
+runs the clients, each with a single request in flight. Each run prints one
+JSON object per line with throughput, round trip percentiles in microseconds
+and the reads the clients needed per response, which goes up when responses
+leave the server in pieces.
+'''
+import json
+import os
+import signal
+import sys
+import threading
+import time
+from hdr import Histogram
+from util import raise_nofile
+
+from net.async import tcp
+from net.async.multiplexer import Multiplexer
+from loopback import connect_all, option
+
+PARTS = (1, 4, 16)
+CONNECTIONS = (1, 100)
+REQUEST = 'x' * 64
+RESPONSE = 256
+
+
+def serve(parts, report):
+    raise_nofile(1024)
+    async = Multiplexer()
+    server = tcp.Server(('127.0.0.1', 0), backlog=1024, async=async)
+    part = 'r' * (RESPONSE // parts)
+
+    def respond(conn, chunk):
+        for x in xrange(conn.recv_queued // len(REQUEST)):
+            conn.read(len(REQUEST))
+            for y in xrange(parts):
+                conn.send(part)
+
+    def accept(conn):
+        conn.retain = True
+        conn.hook('recv', respond)
+
+    server.hook('accept', accept)
+    os.write(report, json.dumps(server.address) + '\n')
+    async.run()
+
+
+class Load(object):
+    def __init__(self, size):
+        self.size = size
+        self.latency = Histogram()
+        self.operations = 0
+        self.now = time.time
+
+    def start(self, conn):
+        conn.retain = True
+        conn.hook('recv', self.recv)
+        self.request(conn)
+
+    def request(self, conn):
+        conn.sent = self.now()
+        conn.send(REQUEST)
+
+    def recv(self, conn, chunk):
+        if conn.recv_queued >= self.size:
+            conn.read(self.size)
+            self.latency.record((self.now() - conn.sent) * 1e6)
+            self.operations += 1
+            self.request(conn)
+
+
+def run(parts, connections, duration):
+    result = {
+        'parts': parts,
+        'connections': connections,
+    }
+    report, write = os.pipe()
+    pid = os.fork()
+    if pid == 0:
+        os.close(report)
+        try:
+            serve(parts, write)
+        finally:
+            os._exit(0)
+    os.close(write)
+
+    try:
+        address = tuple(json.loads(os.fdopen(report).readline()))
+        async = Multiplexer()
+        conns, failed = connect_all(async, address, connections)
+        result['connect_failed'] = failed
+
+        load = Load(RESPONSE // parts * parts)
+        for conn in conns:
+            load.start(conn)
+        reads = sum(conn.recv_calls for conn in conns)
+        timer = threading.Timer(duration, async.stop)
+        start = time.time()
+        timer.start()
+        async.run()
+        elapsed = time.time() - start
+        reads = sum(conn.recv_calls for conn in conns) - reads
+
+        result['seconds'] = round(elapsed, 3)
+        result['operations_per_second'] = round(load.operations / elapsed, 1)
+        result['reads_per_response'] = round(reads / max(load.operations, 1.0),
+            2)
+        result['latency_us'] = load.latency.summary()
+    finally:
+        os.kill(pid, signal.SIGKILL)
+        os.waitpid(pid, 0)
+
+    for conn in conns:
+        if conn.socket:
+            conn.socket.close()
+    async.poller.close()
+    return result
+
+if __name__ == '__main__':
+    if '--help' in sys.argv:
+        print __doc__
+        sys.exit(0)
+
+    duration = float(option('duration', ['2'])[0])
+    for connections in map(int, option('connections', CONNECTIONS)):
+        for parts in map(int, option('parts', PARTS)):
+            print json.dumps(run(parts, connections, duration),
+                sort_keys=True)
+            sys.stdout.flush()
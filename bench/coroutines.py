@@ -0,0 +1,150 @@
+'''
+Line echo server written with hooks versus written as a coroutine, over
+loopback TCP.
+
+    python bench/coroutines.py [--style=callback,coroutine]
+        [--connections=1,100,1000] [--duration=seconds]
+
+The server runs in a child process in the style under test, the load is
+generated in this process: every connection keeps a few lines in flight and
+sends a new one for each echo it gets back. Each run prints one JSON object
+per line with throughput and round trip percentiles in microseconds.
+'''
+import json
+import os
+import signal
+import sys
+import threading
+import time
+from collections import deque
+from hdr import Histogram
+from util import raise_nofile
+
+from net.async import tcp
+from net.async.coroutine import spawn
+from net.async.multiplexer import Multiplexer
+from loopback import connect_all, option
+
+STYLES = ('callback', 'coroutine')
+CONNECTIONS = (1, 100, 1000)
+LINE = 'x' * 62
+DEPTH = 4
+
+
+# Server side, runs in the child
+
+def callback_echo(conn, chunk):
+    data = conn.partial + conn.read()
+    lines = data.split('\n')
+    conn.partial = lines.pop()
+    for line in lines:
+        conn.send_line(line.rstrip('\r'))
+
+def coroutine_echo(conn):
+    while True:
+        line = yield conn.read_line()
+        if line is None:
+            break
+        conn.send_line(line)
+        yield conn.drain()
+
+def serve(style, connections, report):
+    raise_nofile(connections + 256)
+    async = Multiplexer()
+    server = tcp.Server(('127.0.0.1', 0), backlog=4096, async=async)
+
+    def accept(conn):
+        if style == 'callback':
+            conn.partial = ''
+            conn.hook('recv', callback_echo)
+        else:
+            spawn(coroutine_echo(conn))
+
+    server.hook('accept', accept)
+    os.write(report, json.dumps(server.address) + '\n')
+    async.run()
+
+
+# Client side, generates the load
+
+class Load(object):
+    def __init__(self):
+        self.latency = Histogram()
+        self.lines = 0
+        self.now = time.time
+
+    def start(self, conn):
+        conn.retain = True
+        conn.inflight = deque()
+        conn.hook('recv', self.recv)
+        for x in xrange(DEPTH):
+            self.request(conn)
+
+    def request(self, conn):
+        conn.inflight.append(self.now())
+        conn.send_line(LINE)
+
+    def recv(self, conn, chunk):
+        size = len(LINE) + 2
+        now = self.now()
+        while conn.recv_queued >= size:
+            conn.read(size)
+            self.latency.record((now - conn.inflight.popleft()) * 1e6)
+            self.lines += 1
+            self.request(conn)
+
+
+def run(style, connections, duration):
+    result = {
+        'style': style,
+        'connections': connections,
+    }
+    report, write = os.pipe()
+    pid = os.fork()
+    if pid == 0:
+        os.close(report)
+        try:
+            serve(style, connections, write)
+        finally:
+            os._exit(0)
+    os.close(write)
+
+    try:
+        raise_nofile(connections + 256)
+        address = tuple(json.loads(os.fdopen(report).readline()))
+        async = Multiplexer()
+        conns, failed = connect_all(async, address, connections)
+        result['connect_failed'] = failed
+
+        load = Load()
+        for conn in conns:
+            load.start(conn)
+        timer = threading.Timer(duration, async.stop)
+        start = time.time()
+        timer.start()
+        async.run()
+        elapsed = time.time() - start
+
+        result['seconds'] = round(elapsed, 3)
+        result['lines'] = load.lines
+        result['lines_per_second'] = round(load.lines / elapsed, 1)
+        result['latency_us'] = load.latency.summary()
+    finally:
+        os.kill(pid, signal.SIGTERM)
+        os.waitpid(pid, 0)
+
+    for conn in conns:
+        conn.socket.close()
+    async.poller.close()
+    return result
+
+if __name__ == '__main__':
+    if '--help' in sys.argv:
+        print __doc__
+        sys.exit(0)
+
+    duration = float(option('duration', ['2'])[0])
+    for connections in map(int, option('connections', CONNECTIONS)):
+        for style in option('style', STYLES):
+            print json.dumps(run(style, connections, duration), sort_keys=True)
+            sys.stdout.flush()
@@ -0,0 +1,166 @@
+'''
+Latency of well-behaved clients while the server is overloaded, over
+loopback TCP.
+
+    python bench/fairness.py [--load=none,hog,storm,both] [--clients=50]
+        [--duration=seconds]
+
+The echo server runs in a child process. This process runs the measured
+clients, each with a single 64 byte request in flight. The load is
+generated in other processes:
+
+    hog    a few connections that send and read back 64 KiB blocks as fast
+           as they can
+    storm  connects and disconnects as fast as it can
+
+Each run prints one JSON object per line with the throughput of the measured
+clients and their latency percentiles in microseconds.
+'''
+import json
+import os
+import signal
+import socket
+import sys
+import threading
+import time
+from hdr import Histogram
+from util import raise_nofile
+
+from net.async import tcp
+from net.async.multiplexer import Multiplexer
+from loopback import connect_all, option
+
+LOADS = ('none', 'hog', 'storm', 'both')
+REQUEST = 'x' * 64
+HOGS = 4
+HOG_BLOCK = 'h' * 65536
+
+
+def serve(report):
+    raise_nofile(4096)
+    async = Multiplexer()
+    server = tcp.Server(('127.0.0.1', 0), backlog=4096, async=async)
+
+    def echo(conn, chunk):
+        data = conn.read()
+        # Drop what does not fit, the hogs read slower than they write
+        if conn.send_queued + len(data) <= conn.send_limit:
+            conn.send(data)
+
+    server.hook('accept', lambda conn: conn.hook('recv', echo))
+    os.write(report, json.dumps(server.address) + '\n')
+    async.run()
+
+
+def hog(address):
+    def drain(sock):
+        while sock.recv(65536):
+            pass
+
+    def flood(sock):
+        while True:
+            sock.sendall(HOG_BLOCK)
+
+    for x in xrange(HOGS):
+        sock = socket.create_connection(address)
+        for target in (drain, flood):
+            thread = threading.Thread(target=target, args=(sock,))
+            thread.daemon = True
+            thread.start()
+    while True:
+        time.sleep(1)
+
+def storm(address):
+    while True:
+        try:
+            socket.create_connection(address).close()
+        except socket.error:
+            pass
+
+def spawn(function, *args):
+    pid = os.fork()
+    if pid == 0:
+        try:
+            function(*args)
+        finally:
+            os._exit(0)
+    return pid
+
+
+class Load(object):
+    def __init__(self):
+        self.latency = Histogram()
+        self.operations = 0
+        self.now = time.time
+
+    def start(self, conn):
+        conn.retain = True
+        conn.hook('recv', self.recv)
+        self.request(conn)
+
+    def request(self, conn):
+        conn.sent = self.now()
+        conn.send(REQUEST)
+
+    def recv(self, conn, chunk):
+        if conn.recv_queued >= len(REQUEST):
+            conn.read(len(REQUEST))
+            self.latency.record((self.now() - conn.sent) * 1e6)
+            self.operations += 1
+            self.request(conn)
+
+
+def run(load, clients, duration):
+    result = {
+        'load': load,
+        'clients': clients,
+    }
+    report, write = os.pipe()
+    pids = [spawn(lambda: (os.close(report), serve(write)))]
+    os.close(write)
+
+    try:
+        address = tuple(json.loads(os.fdopen(report).readline()))
+        if load in ('hog', 'both'):
+            pids.append(spawn(hog, address))
+        if load in ('storm', 'both'):
+            pids.append(spawn(storm, address))
+
+        async = Multiplexer()
+        conns, failed = connect_all(async, address, clients)
+        result['connect_failed'] = failed
+
+        measured = Load()
+        for conn in conns:
+            measured.start(conn)
+        timer = threading.Timer(duration, async.stop)
+        start = time.time()
+        timer.start()
+        async.run()
+        elapsed = time.time() - start
+
+        result['seconds'] = round(elapsed, 3)
+        result['operations_per_second'] = round(measured.operations / elapsed,
+            1)
+        result['latency_us'] = measured.latency.summary()
+    finally:
+        for pid in reversed(pids):
+            os.kill(pid, signal.SIGKILL)
+            os.waitpid(pid, 0)
+
+    for conn in conns:
+        if conn.socket:
+            conn.socket.close()
+    async.poller.close()
+    return result
+
+if __name__ == '__main__':
+    if '--help' in sys.argv:
+        print __doc__
+        sys.exit(0)
+
+    duration = float(option('duration', ['3'])[0])
+    clients = int(option('clients', ['50'])[0])
+    for load in option('load', LOADS):
+        print json.dumps(run(load, clients, duration), sort_keys=True)
+        sys.stdout.flush()
@@ -0,0 +1,89 @@
+'''
+AX.25 frame decoder benchmark: frames per second for an APRS like mix of
+stations and digipeater paths, decoded to records and to tuples by the
+native decoder, and by the pure Python fallback.
+
+    python bench/frames.py [--seconds=N] [--stations=N]
+
+Results are printed as JSON, one object per line.
+'''
+import json
+import random
+import sys
+import time
+import util
+
+from net.family import frame
+
+PATHS = [(), ('WIDE1-1',), ('WIDE1-1', 'WIDE2-1'), ('PD0ABC-10*', 'WIDE2-1'),
+    ('PD0ABC-10*', 'NL0MZ-2*', 'WIDE2*')]
+BATCH = 256
+
+
+def callsign(number):
+    letters = 'ABCDEFGHIJKLMNOPQRSTUVWXYZ'
+    call = 'P%s%d%s%s' % (letters[number % 26], number % 10,
+        letters[number // 10 % 26], letters[number // 260 % 26])
+    if number % 3:
+        call = '%s-%d' % (call, number % 16)
+    return call
+
+def measure(function, seconds):
+    calls = 0
+    start = time.time()
+    deadline = start + seconds
+    while True:
+        function()
+        calls += 1
+        if calls & 7 == 0 and time.time() >= deadline:
+            break
+    return calls / (time.time() - start)
+
+def main(args):
+    seconds = 1.0
+    stations = 500
+    for arg in args:
+        if arg.startswith('--seconds='):
+            seconds = float(arg.split('=', 1)[1])
+        elif arg.startswith('--stations='):
+            stations = int(arg.split('=', 1)[1])
+
+    random.seed(0)
+    calls = [callsign(number) for number in xrange(stations)]
+    frames = [frame.encode('APRS', random.choice(calls), random.choice(PATHS),
+        info='!5213.%02dN/00455.%02dE-PHG2360' % (x % 60, x % 59))
+        for x in xrange(BATCH)]
+
+    results = []
+    if frame._frame:
+        decoder = frame._frame.Decoder()
+        results.append(('native', 'records', lambda: decoder.decode(frames)))
+        results.append(('native', 'tuples',
+            lambda: list(decoder.decode(frames))))
+        results.append(('native', 'encode', lambda: [frame._frame.encode('APRS',
+            call, ('WIDE1-1', 'WIDE2-1'), info='test') for call in calls[:BATCH]]))
+    fallback = frame.PyDecoder()
+    results.append(('python', 'tuples', lambda: fallback.decode(frames)))
+    results.append(('python', 'encode', lambda: [frame.py_encode('APRS',
+        call, ('WIDE1-1', 'WIDE2-1'), info='test') for call in calls[:BATCH]]))
+
+    for codec, workload, function in results:
+        print json.dumps({
+            'codec': codec,
+            'workload': workload,
+            'stations': stations,
+            'fps': int(measure(function, seconds) * BATCH),
+        }, sort_keys=True)
+        sys.stdout.flush()
+
+    if frame._frame:
+        print json.dumps({
+            'codec': 'native',
+            'workload': 'callsign_cache',
+            'hits': decoder.hits,
+            'misses': decoder.misses,
+            'callsigns': decoder.callsigns,
+        }, sort_keys=True)
+
+if __name__ == '__main__':
+    main(sys.argv[1:])
@@ -0,0 +1,161 @@
+'''
+Request latency behind a front process that hands connections off to a
+worker, versus one that proxies their bytes, over loopback TCP.
+
+    python bench/handoff.py [--mode=direct,handoff,proxy] [--connections=1,50]
+        [--duration=seconds]
+
+The worker echoes what it gets. In direct mode the clients talk to it
+straight away, in handoff mode a front process passes every connection on
+after its first request, in proxy mode the front relays the bytes of every
+connection over a connection of its own to the worker. This process runs the
+clients, each with a single 64 byte request in flight. Each run prints one
+JSON object per line with throughput and round trip percentiles in
+microseconds.
+'''
+import json
+import os
+import signal
+import sys
+import threading
+import time
+from hdr import Histogram
+from util import raise_nofile
+
+from net.async import handoff, tcp
+from net.async.multiplexer import Multiplexer
+from loopback import connect_all, option
+
+MODES = ('direct', 'handoff', 'proxy')
+CONNECTIONS = (1, 50)
+REQUEST = 'x' * 64
+
+
+def echo(conn, chunk):
+    conn.send(conn.read())
+
+def worker(channel, report):
+    raise_nofile(4096)
+    async = Multiplexer()
+    server = tcp.Server(('127.0.0.1', 0), backlog=1024, async=async)
+    server.hook('accept', lambda conn: conn.hook('recv', echo))
+    channel = handoff.Channel(channel, async=async)
+    channel.hook('connection',
+        lambda channel, conn, tag: conn.hook('recv', echo))
+    os.write(report, json.dumps(server.address) + '\n')
+    async.run()
+
+def front(mode, channel, upstream, report):
+    raise_nofile(4096)
+    async = Multiplexer()
+    server = tcp.Server(('127.0.0.1', 0), backlog=1024, async=async)
+    channel = handoff.Channel(channel, async=async)
+
+    def relay(source, target):
+        source.hook('recv', lambda conn, chunk: target.send(conn.read()))
+        source.hook('close', lambda conn: target.close())
+
+    def accept(conn):
+        if mode == 'handoff':
+            conn.hook('recv', lambda conn, chunk: channel.handoff(conn))
+        else:
+            peer = tcp.Client(upstream, async=async)
+            peer.connect()
+            relay(conn, peer)
+            relay(peer, conn)
+
+    server.hook('accept', accept)
+    os.write(report, json.dumps(server.address) + '\n')
+    async.run()
+
+def spawn(function, *args):
+    report, write = os.pipe()
+    pid = os.fork()
+    if pid == 0:
+        os.close(report)
+        try:
+            function(*(args + (write,)))
+        finally:
+            os._exit(0)
+    os.close(write)
+    return pid, tuple(json.loads(os.fdopen(report).readline()))
+
+
+class Load(object):
+    def __init__(self):
+        self.latency = Histogram()
+        self.operations = 0
+        self.now = time.time
+
+    def start(self, conn):
+        conn.retain = True
+        conn.hook('recv', self.recv)
+        self.request(conn)
+
+    def request(self, conn):
+        conn.sent = self.now()
+        conn.send(REQUEST)
+
+    def recv(self, conn, chunk):
+        if conn.recv_queued >= len(REQUEST):
+            conn.read(len(REQUEST))
+            self.latency.record((self.now() - conn.sent) * 1e6)
+            self.operations += 1
+            self.request(conn)
+
+
+def run(mode, connections, duration):
+    result = {
+        'mode': mode,
+        'connections': connections,
+    }
+    pids = []
+    ends = handoff.pair()
+    try:
+        pid, upstream = spawn(worker, ends[1])
+        pids.append(pid)
+        address = upstream
+        if mode != 'direct':
+            pid, address = spawn(front, mode, ends[0], upstream)
+            pids.append(pid)
+        for end in ends:
+            end.close()
+
+        async = Multiplexer()
+        conns, failed = connect_all(async, address, connections)
+        result['connect_failed'] = failed
+
+        load = Load()
+        for conn in conns:
+            load.start(conn)
+        timer = threading.Timer(duration, async.stop)
+        start = time.time()
+        timer.start()
+        async.run()
+        elapsed = time.time() - start
+
+        result['seconds'] = round(elapsed, 3)
+        result['operations_per_second'] = round(load.operations / elapsed, 1)
+        result['latency_us'] = load.latency.summary()
+    finally:
+        for pid in pids:
+            os.kill(pid, signal.SIGKILL)
+            os.waitpid(pid, 0)
+
+    for conn in conns:
+        if conn.socket:
+            conn.socket.close()
+    async.poller.close()
+    return result
+
+if __name__ == '__main__':
+    if '--help' in sys.argv:
+        print __doc__
+        sys.exit(0)
+
+    duration = float(option('duration', ['2'])[0])
+    for connections in map(int, option('connections', CONNECTIONS)):
+        for mode in option('mode', MODES):
+            print json.dumps(run(mode, connections, duration),
+                sort_keys=True)
+            sys.stdout.flush()
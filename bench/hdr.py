@@ -0,0 +1,62 @@
+'''
+High dynamic range histogram, after Gil Tene's HdrHistogram. Values are
+counted in power of two buckets that are each split in linear sub buckets,
+which keeps about three significant digits over the whole range at a fixed
+memory cost.
+'''
+from collections import defaultdict
+
+
+class Histogram(object):
+    def __init__(self, digits=3):
+        # Smallest power of two that holds 2 * 10 ** digits sub buckets
+        self.bits = (2 * 10 ** digits - 1).bit_length()
+        self.counts = defaultdict(int)
+        self.total = 0
+        self.sum = 0
+        self.min = None
+        self.max = None
+
+    def record(self, value, count=1):
+        value = int(value)
+        shift = max(0, value.bit_length() - self.bits)
+        self.counts[(shift, value >> shift)] += count
+        self.total += count
+        self.sum += value * count
+        if self.min is None or value < self.min:
+            self.min = value
+        if self.max is None or value > self.max:
+            self.max = value
+
+    def merge(self, other):
+        for key, count in other.counts.iteritems():
+            self.counts[key] += count
+        self.total += other.total
+        self.sum += other.sum
+        for value in (other.min, other.max):
+            if value is not None:
+                self.min = value if self.min is None else min(self.min, value)
+                self.max = value if self.max is None else max(self.max, value)
+
+    def percentile(self, percentile):
+        if not self.total:
+            return None
+        wanted = max(1, int(round(self.total * percentile / 100.0)))
+        seen = 0
+        for shift, sub in sorted(self.counts):
+            seen += self.counts[(shift, sub)]
+            if seen >= wanted:
+                # Highest value that is equivalent to this bucket
+                return min(((sub + 1) << shift) - 1, self.max)
+        return self.max
+
+    def summary(self, percentiles=(50, 90, 99, 99.9)):
+        result = {
+            'count': self.total,
+            'min': self.min,
+            'max': self.max,
+            'mean': self.total and round(float(self.sum) / self.total, 2),
+        }
+        for percentile in percentiles:
+            result['p%s' % (percentile,)] = self.percentile(percentile)
+        return result
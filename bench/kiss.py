@@ -0,0 +1,151 @@
+'''
+KISS codec benchmark: frames per second encoded and decoded by the native
+codec and the pure Python fallback, for several frame sizes and amounts of
+bytes that need escaping, and end to end over a pty pair.
+
+    python bench/kiss.py [--seconds=N] [--pty=frames]
+
+Results are printed as JSON, one object per line.
+'''
+import json
+import os
+import random
+import sys
+import time
+import util
+
+from net.family import kiss
+
+SIZES = (32, 128, 256, 1024)
+# Fraction of payload bytes that are FEND or FESC
+ESCAPES = (0.0, 2 / 256.0, 0.25)
+# Bytes per decoder feed, like reads from a serial line
+READ_SIZE = 4096
+PLAIN = [chr(byte) for byte in xrange(256)
+    if byte not in (kiss.FEND, kiss.FESC)]
+SPECIAL = [chr(kiss.FEND), chr(kiss.FESC)]
+
+
+def payload(size, escapes):
+    return ''.join([random.choice(SPECIAL if random.random() < escapes
+        else PLAIN) for x in xrange(size)])
+
+def measure(function, seconds):
+    '''
+    Call function until seconds have passed, returns calls per second.
+    '''
+    calls = 0
+    start = time.time()
+    deadline = start + seconds
+    while True:
+        function()
+        calls += 1
+        if calls & 15 == 0 and time.time() >= deadline:
+            break
+    return calls / (time.time() - start)
+
+def codec(name, encode, encode_batch, decoder, size, escapes, seconds):
+    frames = [payload(size, escapes) for x in xrange(64)]
+    stream = encode_batch(frames)
+    reads = [stream[offset:offset + READ_SIZE]
+        for offset in xrange(0, len(stream), READ_SIZE)]
+
+    def encode_each():
+        for frame in frames:
+            encode(frame)
+
+    def encode_all():
+        encode_batch(frames)
+
+    def decode():
+        feed = decoder.feed
+        for read in reads:
+            feed(read)
+
+    return {
+        'codec': name,
+        'frame_size': size,
+        'escapes': round(escapes, 4),
+        'encode_fps': int(measure(encode_each, seconds) * len(frames)),
+        'encode_batch_fps': int(measure(encode_all, seconds) * len(frames)),
+        'decode_fps': int(measure(decode, seconds) * len(frames)),
+        'decode_mbytes_per_second': round(measure(decode, seconds)
+            * len(stream) / (1 << 20), 1),
+    }
+
+def pty(count):
+    from net.async import kiss as async_kiss
+    from net.async.multiplexer import Multiplexer
+
+    master, slave = os.openpty()
+    async_kiss.TNC.configure(master)
+    frames = [payload(random.randint(64, 256), 2 / 256.0) for x in xrange(256)]
+    stream = kiss.encode_batch(frames)
+    rounds = count // len(frames)
+
+    pid = os.fork()
+    if pid == 0:
+        os.close(slave)
+        for x in xrange(rounds):
+            data = stream
+            while data:
+                data = data[os.write(master, data):]
+        # Wait for the host to hang up
+        try:
+            while os.read(master, 4096):
+                pass
+        except OSError:
+            pass
+        os._exit(0)
+    os.close(master)
+
+    async = Multiplexer()
+    tnc = async_kiss.TNC(os.ttyname(slave), async=async)
+    os.close(slave)
+    state = {'frames': 0}
+    def on_frame(tnc, port, frame):
+        state['frames'] += 1
+        if state['frames'] == rounds * len(frames):
+            async.stop()
+    tnc.hook('frame', on_frame)
+
+    start = time.time()
+    async.run()
+    elapsed = time.time() - start
+    tnc.close()
+    os.waitpid(pid, 0)
+    return {
+        'codec': kiss._kiss and 'native' or 'python',
+        'workload': 'pty',
+        'frames': state['frames'],
+        'seconds': round(elapsed, 4),
+        'fps': int(state['frames'] / elapsed),
+        'reads': tnc.recv_calls,
+    }
+
+def main(args):
+    seconds = 0.5
+    frames = 100000
+    for arg in args:
+        if arg.startswith('--seconds='):
+            seconds = float(arg.split('=', 1)[1])
+        elif arg.startswith('--pty='):
+            frames = int(arg.split('=', 1)[1])
+
+    random.seed(0)
+    codecs = [('python', kiss.py_encode, kiss.py_encode_batch, kiss.PyDecoder)]
+    if kiss._kiss:
+        codecs.insert(0, ('native', kiss._kiss.encode,
+            kiss._kiss.encode_batch, kiss._kiss.Decoder))
+    for size in SIZES:
+        for escapes in ESCAPES:
+            for name, encode, encode_batch, decoder in codecs:
+                print json.dumps(codec(name, encode, encode_batch, decoder(),
+                    size, escapes, seconds), sort_keys=True)
+                sys.stdout.flush()
+
+    if frames:
+        print json.dumps(pty(frames), sort_keys=True)
+
+if __name__ == '__main__':
+    main(sys.argv[1:])
@@ -0,0 +1,260 @@
+'''
+Loopback benchmark of tcp.Server and tcp.Client on every poller backend.
+
+    python bench/loopback.py [--workload=echo,reqresp,bulk]
+        [--backend=epoll,_epoll,select] [--connections=10,1000,10000,50000]
+        [--duration=seconds]
+
+Workloads:
+
+    echo     every connection keeps a few pipelined messages in flight
+    reqresp  every connection has exactly one request outstanding
+    bulk     the server streams to every connection as fast as it can
+
+The server runs in a child process, the load is generated and measured in
+this process, both on the same backend. Each run prints one JSON object per
+line with throughput and latency percentiles in microseconds; runs that
+cannot be done on this host are reported with a skipped reason.
+'''
+import json
+import os
+import select
+import signal
+import sys
+import threading
+import time
+from collections import deque
+from hdr import Histogram
+from util import raise_nofile
+
+from net.async import multiplexer, tcp
+from net.async.multiplexer import Multiplexer
+
+WORKLOADS = ('echo', 'reqresp', 'bulk')
+CONNECTIONS = (10, 1000, 10000, 50000)
+
+# Message sizes and pipeline depth
+ECHO_SIZE = 512
+ECHO_DEPTH = 4
+REQUEST_SIZE = 64
+BULK_BLOCK = 'x' * 65536
+
+# Maximum number of connects in flight
+CONNECT_WINDOW = 256
+
+# Highest descriptor select() can watch
+FD_SETSIZE = getattr(select, 'FD_SETSIZE', 1024)
+
+
+def backends():
+    result = {}
+    if hasattr(select, 'epoll'):
+        result['epoll'] = select.epoll
+    if multiplexer._epoll:
+        result['_epoll'] = multiplexer._epoll_like_epoll
+    result['select'] = multiplexer.select_like_epoll
+    return result
+
+def skip_reason(backend, connections):
+    limit = raise_nofile(connections + 256)
+    if limit < connections + 64:
+        return 'open files limit %d too low' % (limit,)
+    low, high = map(int, open('/proc/sys/net/ipv4/ip_local_port_range')
+        .read().split())
+    if connections > high - low:
+        return 'only %d local ports available' % (high - low,)
+    if backend == 'select' and connections + 16 > FD_SETSIZE:
+        return 'select() is limited to FD_SETSIZE descriptors'
+    return None
+
+
+# Server side, runs in the child
+
+def serve(backend, workload, connections, report):
+    raise_nofile(connections + 256)
+    async = Multiplexer(backends()[backend]())
+    server = tcp.Server(('127.0.0.1', 0), backlog=4096, async=async)
+
+    def echo(conn, chunk):
+        conn.send(conn.read())
+
+    def stream(conn, *args):
+        while not 'send' in conn.paused:
+            conn.send(BULK_BLOCK)
+
+    def accept(conn):
+        if workload == 'bulk':
+            conn.hook('resume', stream)
+            stream(conn)
+        else:
+            conn.hook('recv', echo)
+
+    server.hook('accept', accept)
+    os.write(report, json.dumps(server.address) + '\n')
+    async.run()
+
+
+# Client side, generates the load
+
+class Load(object):
+    def __init__(self, async, workload):
+        self.async = async
+        self.workload = workload
+        self.latency = Histogram()
+        self.operations = 0
+        self.bytes = 0
+        self.now = time.time
+
+    def start(self, conn):
+        # Answers are read once they are complete
+        conn.retain = True
+        if self.workload == 'echo':
+            conn.hook('recv', self.echo)
+            conn.inflight = deque()
+            for x in xrange(ECHO_DEPTH):
+                self.request(conn, ECHO_SIZE)
+        elif self.workload == 'reqresp':
+            conn.hook('recv', self.reqresp)
+            conn.inflight = deque()
+            self.request(conn, REQUEST_SIZE)
+        else:
+            conn.hook('recv', self.bulk)
+
+    def request(self, conn, size):
+        conn.inflight.append(self.now())
+        conn.send('x' * size)
+
+    def complete(self, conn, size):
+        conn.read(size)
+        self.latency.record((self.now() - conn.inflight.popleft()) * 1e6)
+        self.operations += 1
+        self.bytes += size
+
+    def echo(self, conn, chunk):
+        while conn.queued['recv'] >= ECHO_SIZE:
+            self.complete(conn, ECHO_SIZE)
+            self.request(conn, ECHO_SIZE)
+
+    def reqresp(self, conn, chunk):
+        if conn.queued['recv'] >= REQUEST_SIZE:
+            self.complete(conn, REQUEST_SIZE)
+            self.request(conn, REQUEST_SIZE)
+
+    def bulk(self, conn, chunk):
+        self.bytes += len(conn.read())
+        self.operations += 1
+
+
+def connect_all(async, address, count, timeout=120):
+    '''
+    Open count connections with a bounded number of connects in flight.
+    '''
+    state = {'started': 0, 'failed': 0}
+    conns = []
+
+    def start():
+        state['started'] += 1
+        conn = tcp.Client(address, async=async)
+        conn.hook('close', closed)
+        conn.connect(callback=connected)
+
+    def connected(conn):
+        conns.append(conn)
+        if len(conns) + state['failed'] == count:
+            async.stop()
+        elif state['started'] < count:
+            start()
+
+    def closed(conn):
+        if not conn in conns:
+            state['failed'] += 1
+            connected(conn)
+            conns.remove(conn)
+
+    for x in xrange(min(count, CONNECT_WINDOW)):
+        start()
+    timer = threading.Timer(timeout, async.stop)
+    timer.start()
+    async.run()
+    timer.cancel()
+    return conns, state['failed']
+
+def run(backend, workload, connections, duration):
+    result = {
+        'backend': backend,
+        'workload': workload,
+        'connections': connections,
+    }
+    reason = skip_reason(backend, connections)
+    if reason:
+        result['skipped'] = reason
+        return result
+
+    report, write = os.pipe()
+    pid = os.fork()
+    if pid == 0:
+        os.close(report)
+        try:
+            serve(backend, workload, connections, write)
+        finally:
+            os._exit(0)
+    os.close(write)
+
+    try:
+        address = tuple(json.loads(os.fdopen(report).readline()))
+        async = Multiplexer(backends()[backend]())
+        start = time.time()
+        conns, failed = connect_all(async, address, connections)
+        result['connect_seconds'] = round(time.time() - start, 3)
+        result['connect_failed'] = failed
+
+        load = Load(async, workload)
+        for conn in conns:
+            load.start(conn)
+        timer = threading.Timer(duration, async.stop)
+        start = time.time()
+        timer.start()
+        async.run()
+        elapsed = time.time() - start
+
+        result['seconds'] = round(elapsed, 3)
+        result['operations'] = load.operations
+        result['operations_per_second'] = round(load.operations / elapsed, 1)
+        result['mbytes_per_second'] = round(load.bytes / elapsed / (1 << 20),
+            2)
+        if workload != 'bulk':
+            result['latency_us'] = load.latency.summary()
+    finally:
+        os.kill(pid, signal.SIGTERM)
+        os.waitpid(pid, 0)
+
+    for conn in conns:
+        conn.socket.close()
+    async.poller.close()
+    return result
+
+def option(name, default):
+    for arg in sys.argv[1:]:
+        if arg.startswith('--%s=' % (name,)):
+            return arg.split('=', 1)[1].split(',')
+    return default
+
+if __name__ == '__main__':
+    if '--help' in sys.argv:
+        print __doc__
+        sys.exit(0)
+
+    available = backends()
+    duration = float(option('duration', ['2'])[0])
+    for workload in option('workload', WORKLOADS):
+        for backend in option('backend', sorted(available)):
+            if not backend in available:
+                print json.dumps({'backend': backend,
+                    'skipped': 'backend not available'})
+                continue
+            for connections in map(int, option('connections', CONNECTIONS)):
+                print >>sys.stderr, '%s on %s with %d connections ..' % (
+                    workload, backend, connections)
+                print json.dumps(run(backend, workload, connections, duration),
+                    sort_keys=True)
+                sys.stdout.flush()
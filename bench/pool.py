@@ -0,0 +1,140 @@
+'''
+Request latency with a new connection per request versus pooled connections,
+over loopback TCP.
+
+    python bench/pool.py [--mode=fresh,pooled] [--concurrency=1,50]
+        [--duration=seconds]
+
+The echo server runs in a child process. This process keeps that many
+requests in flight, each one gets a connection, sends 64 bytes, waits for
+the echo and then closes the connection or hands it back to the pool. Each
+run prints one JSON object per line with throughput, latency percentiles in
+microseconds from asking for a connection to having the answer, and the pool
+counters.
+'''
+import json
+import os
+import signal
+import sys
+import threading
+import time
+from hdr import Histogram
+from util import raise_nofile
+
+from net.async import tcp
+from net.async.multiplexer import Multiplexer
+from net.async.pool import Pool
+from loopback import option
+
+MODES = ('fresh', 'pooled')
+CONCURRENCY = (1, 50)
+REQUEST = 'x' * 64
+
+
+def serve(report):
+    raise_nofile(4096)
+    async = Multiplexer()
+    server = tcp.Server(('127.0.0.1', 0), backlog=4096, async=async)
+    server.hook('accept', lambda conn: conn.hook('recv',
+        lambda conn, chunk: conn.send(conn.read())))
+    os.write(report, json.dumps(server.address) + '\n')
+    async.run()
+
+
+class Load(object):
+    def __init__(self, async, address, pool):
+        self.async = async
+        self.address = address
+        self.pool = pool
+        self.latency = Histogram()
+        self.operations = 0
+        self.failed = 0
+        self.now = time.time
+
+    def start(self):
+        started = self.now()
+        if self.pool is None:
+            conn = tcp.Client(self.address, async=self.async)
+            conn.hook('error', lambda conn, error: self.ready(None, error,
+                started))
+            conn.connect(callback=lambda conn: self.ready(conn, None, started))
+        else:
+            self.pool.checkout(self.address,
+                lambda conn, error: self.ready(conn, error, started))
+
+    def ready(self, conn, error, started):
+        if error is not None:
+            self.failed += 1
+            self.async.queue(self.start)
+            return
+        conn.started = started
+        conn.retain = True
+        conn.hook('recv', self.recv)
+        conn.send(REQUEST)
+
+    def recv(self, conn, chunk):
+        if conn.recv_queued < len(REQUEST):
+            return
+        conn.read()
+        self.latency.record((self.now() - conn.started) * 1e6)
+        self.operations += 1
+        if self.pool is None:
+            conn.close()
+        else:
+            self.pool.checkin(conn)
+        self.start()
+
+
+def run(mode, concurrency, duration):
+    result = {
+        'mode': mode,
+        'concurrency': concurrency,
+    }
+    report, write = os.pipe()
+    pid = os.fork()
+    if pid == 0:
+        os.close(report)
+        try:
+            serve(write)
+        finally:
+            os._exit(0)
+    os.close(write)
+
+    try:
+        raise_nofile(4096)
+        address = tuple(json.loads(os.fdopen(report).readline()))
+        async = Multiplexer()
+        pool = mode == 'pooled' and Pool(async, max_idle=concurrency) or None
+        load = Load(async, address, pool)
+        for x in xrange(concurrency):
+            load.start()
+        timer = threading.Timer(duration, async.stop)
+        start = time.time()
+        timer.start()
+        async.run()
+        elapsed = time.time() - start
+
+        result['seconds'] = round(elapsed, 3)
+        result['operations_per_second'] = round(load.operations / elapsed, 1)
+        result['failed'] = load.failed
+        result['latency_us'] = load.latency.summary()
+        if pool is not None:
+            result['pool'] = pool.stats()
+            pool.close()
+    finally:
+        os.kill(pid, signal.SIGKILL)
+        os.waitpid(pid, 0)
+    async.poller.close()
+    return result
+
+if __name__ == '__main__':
+    if '--help' in sys.argv:
+        print __doc__
+        sys.exit(0)
+
+    duration = float(option('duration', ['2'])[0])
+    for concurrency in map(int, option('concurrency', CONCURRENCY)):
+        for mode in option('mode', MODES):
+            print json.dumps(run(mode, concurrency, duration),
+                sort_keys=True)
+            sys.stdout.flush()
@@ -0,0 +1,124 @@
+'''
+Receive path benchmark: bulk transfer throughput and memory use of mostly
+idle connections, with adaptive or fixed read sizes.
+
+    python bench/recv_buffers.py bulk [megabytes] [--fixed]
+    python bench/recv_buffers.py idle [connections] [--fixed] [--echo]
+
+With --echo the server sends every byte back, so the idle connections have
+sent data as well. Results are printed as a single JSON object.
+'''
+import json
+import os
+import socket
+import sys
+import time
+from util import raise_nofile, rss
+
+from net.async import tcp
+from net.async.multiplexer import Multiplexer
+
+
+def bulk(megabytes):
+    async = Multiplexer()
+    server = tcp.Server(('127.0.0.1', 0), async=async)
+    total = megabytes << 20
+
+    pid = os.fork()
+    if pid == 0:
+        sock = socket.create_connection(server.address)
+        block = 'x' * 65536
+        for x in xrange(total / len(block)):
+            sock.sendall(block)
+        sock.close()
+        os._exit(0)
+
+    state = {'bytes': 0, 'reads': 0}
+    def on_recv(conn, chunk):
+        state['bytes'] += len(conn.read())
+        state['reads'] += 1
+    def on_accept(conn):
+        state['start'] = time.time()
+        conn.hook('recv', on_recv)
+        conn.hook('close', lambda conn: async.stop())
+    server.hook('accept', on_accept)
+    async.run()
+    elapsed = time.time() - state['start']
+    os.waitpid(pid, 0)
+
+    return {
+        'workload': 'bulk',
+        'bytes': state['bytes'],
+        'reads': state['reads'],
+        'seconds': round(elapsed, 4),
+        'mbytes_per_second': round(state['bytes'] / elapsed / (1 << 20), 2),
+    }
+
+def idle(connections, echo=False):
+    # Both ends of every connection live on this host
+    limit = raise_nofile(connections * 2 + 64)
+    connections = min(connections, (limit - 64) // 2)
+    async = Multiplexer()
+    server = tcp.Server(('127.0.0.1', 0), backlog=4096, async=async)
+
+    wait, release = os.pipe()
+    pid = os.fork()
+    if pid == 0:
+        os.close(release)
+        socks = []
+        for x in xrange(connections):
+            sock = socket.create_connection(server.address)
+            sock.send('x')
+            socks.append(sock)
+        os.read(wait, 1)
+        os._exit(0)
+    os.close(wait)
+
+    state = {'accepted': 0, 'bytes': 0, 'conns': []}
+    def on_recv(conn, chunk):
+        state['bytes'] += len(chunk)
+        if echo:
+            conn.send(chunk)
+        if state['bytes'] == connections:
+            async.stop()
+    def on_accept(conn):
+        state['accepted'] += 1
+        state['conns'].append(conn)
+        conn.hook('recv', on_recv)
+    server.hook('accept', on_accept)
+    before = rss()
+    start = time.time()
+    async.run()
+    elapsed = time.time() - start
+    after = rss()
+    # Counted after measuring, looking at __dict__ creates it
+    with_dict = sum(1 for conn in state['conns'] if conn.__dict__)
+    os.write(release, 'x')
+    os.waitpid(pid, 0)
+
+    return {
+        'workload': 'idle',
+        'echo': echo,
+        'connections': state['accepted'],
+        'connections_with_dict': with_dict,
+        'seconds': round(elapsed, 4),
+        'rss_bytes': after,
+        'rss_bytes_per_connection': (after - before) // max(1, state['accepted']),
+    }
+
+if __name__ == '__main__':
+    args = [arg for arg in sys.argv[1:] if not arg.startswith('--')]
+    if not args or args[0] not in ('bulk', 'idle'):
+        print >>sys.stderr, __doc__
+        sys.exit(1)
+
+    if '--fixed' in sys.argv:
+        tcp.Base.min_blocksize = tcp.Base.max_blocksize = 4096
+
+    if args[0] == 'bulk':
+        result = bulk(int(args[1]) if len(args) > 1 else 256)
+    else:
+        result = idle(int(args[1]) if len(args) > 1 else 50000,
+            '--echo' in sys.argv)
+    result['read_size'] = '--fixed' in sys.argv and 'fixed' or 'adaptive'
+    print json.dumps(result, sort_keys=True)
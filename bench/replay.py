@@ -0,0 +1,178 @@
+'''
+Traffic capture and replay over loopback TCP.
+
+    python bench/replay.py [--speed=1,10] [--connections=50]
+        [--duration=seconds] [--capture=path --target=host:port]
+
+With a capture and a target, replays the capture against the server at
+target. Otherwise it makes its own: the echo server runs in a child process,
+first without and then with capture, each under as much request/response
+load as this process can generate to show what capturing costs. It is
+captured once more under a paced load, every connection waiting a random
+think time between requests. That capture is then replayed against a new
+server at every speed. Each run prints one JSON object per line, replays
+with throughput and latency percentiles in microseconds next to the ones of
+the capture.
+'''
+import json
+import os
+import random
+import signal
+import sys
+import tempfile
+import threading
+import time
+from hdr import Histogram
+from util import raise_nofile
+
+from net.async import tcp
+from net.async.capture import Capture, Replay
+from net.async.multiplexer import Multiplexer
+from loopback import connect_all, option
+
+SPEEDS = (1, 10)
+REQUEST = 'x' * 64
+# Mean think time of paced connections in seconds
+THINK = 0.02
+
+
+def serve(path, report):
+    raise_nofile(4096)
+    if path:
+        tcp.Base.capture = Capture(path)
+    async = Multiplexer()
+    server = tcp.Server(('127.0.0.1', 0), backlog=1024, async=async)
+    server.hook('accept', lambda conn: conn.hook('recv',
+        lambda conn, chunk: conn.send(conn.read())))
+    os.write(report, json.dumps(server.address) + '\n')
+    async.run()
+
+def spawn(path):
+    report, write = os.pipe()
+    pid = os.fork()
+    if pid == 0:
+        os.close(report)
+        try:
+            serve(path, write)
+        finally:
+            os._exit(0)
+    os.close(write)
+    return pid, tuple(json.loads(os.fdopen(report).readline()))
+
+
+class Load(object):
+    '''
+    One request in flight per connection, think seconds apart on average.
+    '''
+    def __init__(self, async, think):
+        self.async = async
+        self.think = think
+        # The same think times every run
+        self.random = random.Random(42)
+        self.latency = Histogram()
+        self.operations = 0
+        self.now = time.time
+
+    def start(self, conn):
+        conn.retain = True
+        conn.hook('recv', self.recv)
+        self.request(conn)
+
+    def request(self, conn):
+        if not conn.socket:
+            return
+        conn.sent = self.now()
+        conn.send(REQUEST)
+
+    def recv(self, conn, chunk):
+        if conn.recv_queued < len(REQUEST):
+            return
+        conn.read(len(REQUEST))
+        self.latency.record((self.now() - conn.sent) * 1e6)
+        self.operations += 1
+        if self.think:
+            self.async.later(self.random.expovariate(1 / self.think),
+                self.request, conn)
+        else:
+            self.request(conn)
+
+
+def load(path, connections, duration, think):
+    result = {
+        'capture': bool(path),
+        'connections': connections,
+        'think': think,
+    }
+    pid, address = spawn(path)
+    try:
+        async = Multiplexer()
+        conns, failed = connect_all(async, address, connections)
+        result['connect_failed'] = failed
+        generator = Load(async, think)
+        for conn in conns:
+            generator.start(conn)
+        timer = threading.Timer(duration, async.stop)
+        start = time.time()
+        timer.start()
+        async.run()
+        elapsed = time.time() - start
+
+        result['seconds'] = round(elapsed, 3)
+        result['operations_per_second'] = round(generator.operations
+            / elapsed, 1)
+        result['latency_us'] = generator.latency.summary()
+    finally:
+        os.kill(pid, signal.SIGKILL)
+        os.waitpid(pid, 0)
+    for conn in conns:
+        if conn.socket:
+            conn.close()
+    async.poller.close()
+    return result
+
+def replay(path, speed, address=None):
+    pid = None
+    if address is None:
+        pid, address = spawn(None)
+    try:
+        async = Multiplexer()
+        result = Replay(path, address, speed, async).run()
+    finally:
+        if pid is not None:
+            os.kill(pid, signal.SIGKILL)
+            os.waitpid(pid, 0)
+    async.poller.close()
+    return result
+
+def report(result):
+    print json.dumps(result, sort_keys=True)
+    sys.stdout.flush()
+
+if __name__ == '__main__':
+    if '--help' in sys.argv:
+        print __doc__
+        sys.exit(0)
+
+    raise_nofile(4096)
+    speeds = map(float, option('speed', SPEEDS))
+    path = option('capture', [None])[0]
+    if path:
+        host, port = option('target', ['127.0.0.1:8000'])[0].rsplit(':', 1)
+        for speed in speeds:
+            report(replay(path, speed, (host, int(port))))
+        sys.exit(0)
+
+    duration = float(option('duration', ['2'])[0])
+    connections = int(option('connections', ['50'])[0])
+    fd, path = tempfile.mkstemp(suffix='.cap')
+    os.close(fd)
+    try:
+        # What capturing costs a saturated server
+        report(load(None, connections, duration, 0))
+        report(load(path, connections, duration, 0))
+
+        report(load(path, connections, duration, THINK))
+        for speed in speeds:
+            report(replay(path, speed))
+    finally:
+        os.unlink(path)
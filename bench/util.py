@@ -0,0 +1,31 @@
+'''
+Helpers shared by the benchmarks.
+'''
+import os
+import resource
+import sys
+
+# Benchmarks run from a source checkout
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)),
+    '..'))
+
+
+def rss():
+    '''
+    Resident set size of this process in bytes.
+    '''
+    for line in open('/proc/self/status'):
+        if line.startswith('VmRSS:'):
+            return int(line.split()[1]) * 1024
+    return 0
+
+def raise_nofile(wanted):
+    '''
+    Raise the open files limit as far as allowed, returns the new limit.
+    '''
+    soft, hard = resource.getrlimit(resource.RLIMIT_NOFILE)
+    if hard != resource.RLIM_INFINITY:
+        wanted = min(wanted, hard)
+    soft = max(soft, wanted)
+    resource.setrlimit(resource.RLIMIT_NOFILE, (soft, hard))
+    return soft
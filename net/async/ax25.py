@@ -0,0 +1,174 @@
+import errno
+from net.async.const import *
+from net.async.nonblocking import NonBlocking
+from net.family import ax25, bare
+from net.tools import get_errno
+
+
+class Base(NonBlocking):
+    '''
+    Connected mode AX.25 (SOCK_SEQPACKET) socket. Every read hands out a single
+    frame and every queued send goes out as a single frame.
+    '''
+    # Largest frame we expect from the kernel, AX.25 paclen is way below this
+    frame_size = 2048
+
+    def __init__(self, sock=None, async=None):
+        super(Base, self).__init__(sock or bare.AF_AX25, bare.SOCK_SEQPACKET, 0,
+            async)
+        self.connected = False
+        self.connecting = False
+
+    def __repr__(self):
+        return unicode(self)
+
+    def __unicode__(self):
+        return u'<ax25.Base>'
+
+    def create_socket(self, family, type, proto):
+        if isinstance(family, bare.socket):
+            return family
+        return ax25.socket(family, type, proto)
+
+    def handler(self, eventmask):
+        if not self.socket:
+            return
+
+        try:
+            if eventmask & READABLE:
+                self.handle_recv()
+            if not self.socket:
+                return
+            if eventmask & WRITABLE:
+                self.handle_send()
+            if not self.socket:
+                return
+
+            # Disconnects are picked up by the read, unless we stopped reading
+            if eventmask & ERROR and not eventmask & READABLE:
+                self.async.queue(self.close)
+                return
+
+            self.update_state()
+        except Exception, error:
+            print self, 'UNHANDLED error in handler', error
+            self.close()
+            raise
+
+    def handle_recv(self):
+        try:
+            self.recv_calls += 1
+            frame = self.socket.recv(self.frame_size)
+        except EnvironmentError, e:
+            if get_errno(e) in (errno.EWOULDBLOCK, errno.EAGAIN):
+                return 0
+            raise
+
+        if not frame:
+            self.close()
+            return 0
+
+        self.recv_bytes += len(frame)
+        self.received(frame)
+        return len(frame)
+
+    def send(self, frame):
+        self.queue_data('send', frame)
+        if self.states is not None and not self.states & WRITABLE:
+            self.update_state()
+
+    def send_line(self, line):
+        # Packet radio terminals expect bare carriage returns
+        self.send(''.join([line, '\r']))
+
+    def handle_send(self):
+        buffer = self.send_buffer
+        if not buffer:
+            return
+
+        try:
+            # Sequenced packets are never sent partially
+            self.send_calls += 1
+            size = self.socket.send(buffer[0])
+        except EnvironmentError, e:
+            if get_errno(e) in (errno.EWOULDBLOCK, errno.EAGAIN):
+                return
+            raise
+
+        buffer.pop(0)
+        self.send_bytes += size
+        self.dequeue_data('send', size)
+
+
+class Station(Base):
+    '''
+    Connection with a single remote station, as accepted by a Server.
+    '''
+
+    def __init__(self, sock, call, async=None):
+        super(Station, self).__init__(sock, async=async)
+        self.address = call
+        self.connected = True
+        self.update_state()
+
+    def __unicode__(self):
+        return u'<ax25.Station call=%s>' % (self.address,)
+
+
+class Server(Base):
+    '''
+    Listens for connections to our call sign, and keeps track of the
+    connected stations by their call sign.
+    '''
+
+    priority = PRIORITY_LISTENER
+    # Most stations accepted in one turn of the event loop. Kept
+    # small, an accept costs more than serving a request and the rest just
+    # waits in the backlog
+    accept_budget = 4
+
+    def __init__(self, call, backlog=128, async=None):
+        super(Server, self).__init__(async=async)
+        self.socket.bind(call)
+        self.socket.listen(backlog)
+        self.address = call
+        self.connected = True
+        self.stations = {}
+        self.update_state()
+
+    def __unicode__(self):
+        return u'<ax25.Server call=%s stations=%d>' % (self.address,
+            len(self.stations))
+
+    @property
+    def is_reading(self):
+        return not self.is_paused('recv')
+
+    def handle_recv(self):
+        for x in xrange(self.accept_budget):
+            if self.handle_accept() is None or not self.is_reading:
+                break
+
+    def handle_accept(self):
+        try:
+            call, sock = self.socket.accept(bare.SOCK_NONBLOCK
+                | bare.SOCK_CLOEXEC)
+        except EnvironmentError, e:
+            if get_errno(e) in (errno.EWOULDBLOCK, errno.EAGAIN):
+                return None
+            raise
+
+        station = Station(sock, call, async=self.async)
+        self.stations[call] = station
+        station.hook('close', self.handle_station_close)
+        self.fire('accept', station)
+        return station
+
+    def handle_station_close(self, station):
+        if self.stations.get(station.address) is station:
+            del self.stations[station.address]
+
+    def close(self):
+        for station in self.stations.values():
+            station.close()
+        return super(Server, self).close()
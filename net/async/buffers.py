@@ -0,0 +1,37 @@
+from collections import defaultdict
+
+
+class BufferPool(object):
+    '''
+    Pool of reusable receive buffers, handed out in power of two size
+    classes. A Multiplexer owns one pool that is shared by all of its
+    connections, so reading from a socket costs no allocation beyond the
+    resulting string.
+    '''
+
+    def __init__(self, minimum=512, maximum=262144, keep=4):
+        self.minimum = minimum
+        self.maximum = maximum
+        self.keep = keep
+        self.free = defaultdict(list)
+
+    def size_class(self, size):
+        size = min(max(size, self.minimum), self.maximum)
+        # Round up to the next power of two
+        return 1 << (size - 1).bit_length()
+
+    def acquire(self, size):
+        size = self.size_class(size)
+        free = self.free[size]
+        if free:
+            return free.pop()
+        else:
+            return bytearray(size)
+
+    def release(self, buf):
+        free = self.free[len(buf)]
+        if len(free) < self.keep:
+            free.append(buf)
+
+    def clear(self):
+        self.free.clear()
@@ -0,0 +1,370 @@
+'''
+Capturing what tcp connections receive and send into a memory mapped log,
+and replaying a capture against a server. Capture is opt-in, per connection
+or for all of them::
+
+    tcp.Base.capture = Capture('/tmp/traffic.cap')
+    server.capture = Capture('/tmp/traffic.cap')
+
+A Server hands its capture down to the connections it accepts. The log
+starts with a header holding a magic, the capture start time and the end of
+the records, which is updated after every record, so a capture is readable
+while it is being written and after the process died. Every record is the
+time in microseconds since the start, the connection, the kind of record,
+and the length of its data followed by the data. Kinds listed in the data
+argument keep their bytes, the others keep only the length. Sent data is
+recorded as it is written to the socket, so a record holds what one write
+took, not what one send() queued.
+
+Replay drives a capture of the server side of connections against a server:
+what the server received is sent as requests, at the time it was received,
+and what it sent is waited for as the answer. What a server sends before
+the first request, a greeting, is waited for right after connecting.
+Requests of one connection are sent one after the other, a request that is
+due while the previous answer is still out waits for it. The schedule comes
+from the capture alone, so every replay of it sends the same bytes in the
+same order.
+'''
+import mmap
+import os
+import struct
+import time
+from net.async import tcp
+from net.async.const import *
+from net.async.multiplexer import Multiplexer
+from net.async.stats import Histogram
+
+MAGIC = 'netcap01'
+# Magic, start time, end of the records
+HEADER = struct.Struct('<8sdQ')
+# Microseconds since start, connection, kind, length of the data
+RECORD = struct.Struct('<QIBI')
+
+OPEN, RECV, SEND, CLOSE = (CAPTURE_OPEN, CAPTURE_RECV, CAPTURE_SEND,
+    CAPTURE_CLOSE)
+KINDS = {'open': OPEN, 'recv': RECV, 'send': SEND, 'close': CLOSE}
+# Set in the kind of records that only kept the length of their data
+LENGTH_ONLY = 0x80
+
+
+class Capture(object):
+    def __init__(self, path, size=1 << 26, data=('recv', 'send')):
+        self.path = path
+        self.size = size
+        self.keep = frozenset(KINDS[kind] for kind in data)
+        self.offset = HEADER.size
+        self.connections = 0
+        self.records = 0
+        # Records that did not fit anymore
+        self.dropped = 0
+        self.now = time.time
+        self.start = self.now()
+        fd = os.open(path, os.O_RDWR | os.O_CREAT | os.O_TRUNC, 0644)
+        try:
+            os.ftruncate(fd, size)
+            self.map = mmap.mmap(fd, size)
+        finally:
+            os.close(fd)
+        HEADER.pack_into(self.map, 0, MAGIC, self.start, self.offset)
+
+    def close(self):
+        self.map.close()
+        self.map = None
+
+    def stats(self):
+        return {
+            'connections': self.connections,
+            'records': self.records,
+            'dropped': self.dropped,
+            'bytes': self.offset,
+        }
+
+    def record(self, conn, kind, data=''):
+        if self.map is None:
+            return
+        ident = conn.capture_id
+        if ident is None:
+            self.connections += 1
+            ident = conn.capture_id = self.connections
+            if kind != OPEN:
+                # Started before the capture did
+                self.record(conn, OPEN)
+
+        length = len(data)
+        if length and kind not in self.keep:
+            kind |= LENGTH_ONLY
+            data = ''
+        offset = self.offset
+        end = offset + RECORD.size + len(data)
+        if end > self.size:
+            self.dropped += 1
+            return
+        RECORD.pack_into(self.map, offset, int((self.now() - self.start)
+            * 1e6), ident, kind, length)
+        self.map[offset + RECORD.size:end] = data
+        self.offset = end
+        struct.pack_into('<Q', self.map, 16, end)
+        self.records += 1
+
+
+def read_capture(path):
+    '''
+    The records of a capture as (microseconds, connection, kind, length,
+    data) tuples, data is None when only the length was kept.
+    '''
+    fd = os.open(path, os.O_RDONLY)
+    try:
+        data = mmap.mmap(fd, 0, prot=mmap.PROT_READ)
+    finally:
+        os.close(fd)
+
+    try:
+        magic, start, end = HEADER.unpack_from(data, 0)
+        if magic != MAGIC:
+            raise ValueError('%s is not a capture' % (path,))
+        offset = HEADER.size
+        while offset < end:
+            when, ident, kind, length = RECORD.unpack_from(data, offset)
+            offset += RECORD.size
+            chunk = None
+            if not kind & LENGTH_ONLY:
+                chunk = data[offset:offset + length]
+                offset += length
+            yield when, ident, kind & ~LENGTH_ONLY, length, chunk
+    finally:
+        data.close()
+
+
+class Exchange(object):
+    '''
+    A request of a captured connection and the answer the server gave.
+    '''
+    __slots__ = ('due', 'request', 'size', 'answer', 'took')
+
+    def __init__(self, due, request):
+        self.due = due
+        self.request = request
+        # Length of the answer, and the answer if it was kept
+        self.size = 0
+        self.answer = []
+        # Microseconds from the last bit of the request to the last bit of
+        # the answer, as the captured server saw it
+        self.took = 0
+
+
+class Captured(object):
+    '''
+    A captured connection, with its times relative to the start of the
+    capture in microseconds.
+    '''
+    __slots__ = ('opened', 'closed', 'requests', 'received', 'last')
+
+    def __init__(self, opened):
+        self.opened = opened
+        # None when it was still open at the end of the capture
+        self.closed = None
+        self.requests = []
+        # When the last bit of the current request came in
+        self.received = opened
+        # When anything happened last
+        self.last = opened
+
+
+def connections(records):
+    '''
+    Sort captured records into Captured connections, ordered by the time they
+    were opened. Consecutive chunks that were received are one request, what
+    was sent until the next request is its answer. What was sent before the
+    first request is the answer to an empty request, due on connect.
+    '''
+    found = {}
+    order = []
+    for when, ident, kind, length, data in records:
+        connection = found.get(ident)
+        if connection is None:
+            connection = found[ident] = Captured(when)
+            order.append(connection)
+        connection.last = when
+        requests = connection.requests
+        if kind == RECV:
+            if data is None:
+                raise ValueError('requests were captured without their data')
+            if not requests or requests[-1].size:
+                requests.append(Exchange(when, []))
+            requests[-1].request.append(data)
+            connection.received = when
+        elif kind == SEND:
+            if not requests:
+                # A greeting, as in SMTP, NNTP and FTP
+                requests.append(Exchange(connection.opened, []))
+            current = requests[-1]
+            current.size += length
+            if current.answer is not None and data is not None:
+                current.answer.append(data)
+            else:
+                current.answer = None
+            current.took = when - connection.received
+        elif kind == CLOSE:
+            connection.closed = when
+
+    for connection in order:
+        for exchange in connection.requests:
+            exchange.request = ''.join(exchange.request)
+            if exchange.answer is not None:
+                exchange.answer = ''.join(exchange.answer)
+    return order
+
+
+def summary(histogram):
+    snapshot = histogram.snapshot()
+    del snapshot['buckets']
+    return snapshot
+
+
+class Replay(object):
+    '''
+    Replay a capture against the server at address, speed times as fast as
+    it was captured. Every captured connection gets a connection of its own.
+    '''
+
+    def __init__(self, path, address, speed=1.0, async=None):
+        self.address = address
+        self.speed = float(speed)
+        self.async = async or Multiplexer.shared()
+        self.connections = connections(read_capture(path))
+        self.requests = sum(len(connection.requests)
+            for connection in self.connections)
+        self.pending = 0
+        self.completed = 0
+        self.errors = 0
+        # Answers that differ from the captured ones, when those were kept
+        self.mismatched = 0
+        self.bytes = {'recv': 0, 'send': 0}
+        self.latency = Histogram()
+        self.baseline = Histogram()
+        # How late requests went out against their schedule
+        self.lag = Histogram()
+        self.now = time.time
+        self.started = None
+        self.elapsed = 0
+        # The capture is replayed from its first connection on
+        self.origin = self.connections and self.connections[0].opened or 0
+
+    def due(self, captured):
+        '''
+        How long until what happened at captured microseconds into the
+        capture is due.
+        '''
+        return max(0, self.started + (captured - self.origin) / 1e6
+            / self.speed - self.now())
+
+    def run(self, timeout=None):
+        '''
+        Replay everything, or until timeout seconds passed, and report.
+        '''
+        self.started = self.now()
+        for connection in self.connections:
+            for exchange in connection.requests:
+                self.baseline.record(exchange.took)
+            self.pending += 1
+            self.async.later(self.due(connection.opened), self.open,
+                connection)
+        if timeout is not None:
+            self.async.later(timeout, self.async.stop)
+        if self.pending:
+            self.async.run()
+        self.elapsed = self.now() - self.started
+        return self.report()
+
+    def open(self, connection):
+        conn = tcp.Client(self.address, async=self.async)
+        conn.captured = connection
+        conn.requests = list(connection.requests)
+        conn.exchange = None
+        # Answers are read once they are complete
+        conn.retain = True
+        conn.hook('recv', self.handle_recv)
+        conn.hook('error', self.handle_error)
+        conn.hook('close', self.handle_close)
+        conn.connect(callback=self.next)
+
+    def next(self, conn):
+        if not conn.requests:
+            closed = conn.captured.closed
+            if closed is None:
+                # Still open when the capture ended
+                conn.close()
+            else:
+                self.async.later(self.due(closed), conn.close)
+            return
+        exchange = conn.requests.pop(0)
+        delay = self.due(exchange.due)
+        if delay:
+            self.async.later(delay, self.send, conn, exchange)
+        else:
+            self.send(conn, exchange)
+
+    def send(self, conn, exchange):
+        if not conn.socket:
+            return
+        now = self.now()
+        self.lag.record(max(0, (now - self.started) * 1e6
+            - (exchange.due - self.origin) / self.speed))
+        conn.exchange = exchange
+        conn.sent = now
+        if exchange.request:
+            self.bytes['send'] += len(exchange.request)
+            conn.send(exchange.request)
+        if not exchange.size:
+            self.answered(conn, None)
+
+    def handle_recv(self, conn, chunk):
+        exchange = conn.exchange
+        if exchange is None or conn.recv_queued < exchange.size:
+            return
+        answer = conn.read(exchange.size)
+        self.bytes['recv'] += len(answer)
+        self.answered(conn, answer)
+
+    def answered(self, conn, answer):
+        exchange = conn.exchange
+        conn.exchange = None
+        self.completed += 1
+        self.latency.record((self.now() - conn.sent) * 1e6)
+        if answer is not None and exchange.answer is not None \
+                and answer != exchange.answer:
+            self.mismatched += 1
+        self.next(conn)
+
+    def handle_error(self, conn, error):
+        self.errors += 1
+
+    def handle_close(self, conn):
+        if conn.exchange is not None or conn.requests:
+            # Answers that never came
+            self.errors += 1
+        self.pending -= 1
+        if not self.pending:
+            self.async.stop()
+
+    def report(self):
+        ends = [connection.last for connection in self.connections]
+        captured = ends and (max(ends) - self.origin) / 1e6 / self.speed or 0
+        return {
+            'speed': self.speed,
+            'connections': len(self.connections),
+            'requests': self.requests,
+            'completed': self.completed,
+            'errors': self.errors,
+            'mismatched': self.mismatched,
+            'bytes': dict(self.bytes),
+            'seconds': round(self.elapsed, 3),
+            'baseline_seconds': round(captured, 3),
+            'requests_per_second': self.elapsed
+                and round(self.completed / self.elapsed, 1),
+            'baseline_requests_per_second': captured
+                and round(self.requests / captured, 1),
+            'latency_us': summary(self.latency),
+            'baseline_latency_us': summary(self.baseline),
+            'lag_us': summary(self.lag),
+        }
@@ -0,0 +1,170 @@
+import errno
+import os
+from net.async.hookable import Hookable
+
+# Compact native connections, with a pure Python fallback
+try:
+    from net.async import _connection
+except ImportError:
+    _connection = None
+
+
+class PyConnection(Hookable):
+    '''
+    Socket, queues and hooks of a single connection, with the same interface
+    as the _connection extension which is used when it is available.
+    '''
+
+    def __init__(self):
+        super(PyConnection, self).__init__()
+        self.socket = None
+        self.async = None
+        self.address = None
+        self.states = None
+        self.connected = False
+        self.connecting = False
+        # Received data stays queued until it is read, see NonBlocking
+        self.retain = False
+        # Queued sends wait for the Multiplexer to flush them, or for uncork
+        self.dirty = False
+        self.corked = False
+        self.blocksize = 4096
+        self.recv_calls = 0
+        self.recv_bytes = 0
+        self.send_calls = 0
+        self.send_bytes = 0
+        self.recv_buffer = []
+        self.send_buffer = []
+        self.queued = {'recv': 0, 'send': 0}
+        self.paused = set()
+        # Coroutine waiter, and addresses left to try when connecting
+        self.waiter = None
+        self.candidates = None
+
+    @property
+    def fileno(self):
+        if self.socket:
+            return self.socket.fileno()
+        else:
+            return None
+
+    @property
+    def is_reading(self):
+        return bool(self.hooks.get('recv', False)) \
+            and not 'recv' in self.paused
+
+    @property
+    def is_sending(self):
+        return bool(self.send_buffer)
+
+    @property
+    def buffer(self):
+        return {'recv': self.recv_buffer, 'send': self.send_buffer}
+
+    @property
+    def recv_queued(self):
+        return self.queued['recv']
+
+    @property
+    def send_queued(self):
+        return self.queued['send']
+
+    def is_paused(self, queue):
+        return queue in self.paused
+
+    def pause(self, queue):
+        '''
+        Pause one of our queues until resume(), whatever it holds.
+        '''
+        if queue not in self.buffer:
+            raise KeyError('unknown queue %s' % (queue,))
+        if not queue in self.paused:
+            self.paused.add(queue)
+            self.fire('pause', self, queue)
+
+    def resume(self, queue):
+        if queue not in self.buffer:
+            raise KeyError('unknown queue %s' % (queue,))
+        if queue in self.paused:
+            self.paused.discard(queue)
+            self.fire('resume', self, queue)
+
+    def queue_data(self, queue, data, watermark=True):
+        '''
+        Append data to one of our queues, and pause it if it is filling up.
+        Without watermark the queue is never paused, for data that is only
+        queued for a moment.
+        '''
+        size = self.queued[queue] + len(data)
+        if queue == 'send' and self.send_limit and size > self.send_limit:
+            raise IOError(errno.ENOBUFS, os.strerror(errno.ENOBUFS))
+
+        self.buffer[queue].append(data)
+        self.queued[queue] = size
+        if watermark and size >= self.watermarks[queue][1] \
+            and not queue in self.paused:
+            self.paused.add(queue)
+            self.fire('pause', self, queue)
+
+    def dequeue_data(self, queue, size):
+        '''
+        Account for data taken from one of our queues, and resume it once it
+        is drained below the low watermark.
+        '''
+        self.queued[queue] -= size
+        if queue in self.paused \
+            and self.queued[queue] <= self.watermarks[queue][0]:
+            self.paused.discard(queue)
+            self.fire('resume', self, queue)
+            return True
+        return False
+
+    def read(self, size=-1):
+        '''
+        Take up to size bytes (or everything) from the receive queue. Data
+        handed to the recv hooks is queued while they run, it only stays
+        queued until it is read when the connection retains its receive
+        queue, see NonBlocking.retain.
+        '''
+        chunks = self.recv_buffer
+        if size < 0 or size >= self.queued['recv']:
+            data = ''.join(chunks)
+            del chunks[:]
+        else:
+            data = []
+            wanted = size
+            while wanted and chunks:
+                chunk = chunks.pop(0)
+                if len(chunk) > wanted:
+                    chunks.insert(0, chunk[wanted:])
+                    chunk = chunk[:wanted]
+                data.append(chunk)
+                wanted -= len(chunk)
+            data = ''.join(data)
+
+        if data and self.dequeue_data('recv', len(data)):
+            # Resume reading from the socket
+            self.update_state()
+        return data
+
+    def take_line(self):
+        '''
+        Take the first line from the receive queue without its line ending,
+        None if no full line is queued.
+        '''
+        offset = 0
+        for chunk in self.recv_buffer:
+            index = chunk.find('\n')
+            if index != -1:
+                line = self.read(offset + index + 1)
+                if line[-2:] == '\r\n':
+                    return line[:-2]
+                return line[:-1]
+            offset += len(chunk)
+        return None
+
+
+if _connection:
+    Connection = _connection.Connection
+else:
+    Connection = PyConnection
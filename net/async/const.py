@@ -19,6 +19,21 @@ WRITABLE    = POLLOUT
 READABLE    = POLLIN
 ERROR       = POLLERR | POLLHUP | POLLRDHUP
 
+# Busy polling socket options, from <asm-generic/socket.h>
+SO_BUSY_POLL        = 46
+SO_PREFER_BUSY_POLL = 69
+
+# Dispatch priority classes, lower classes are dispatched first so existing
+# connections are served before new ones are accepted
+PRIORITY_DATA     = 0
+PRIORITY_LISTENER = 1
+
+# Kinds of records in a traffic capture, see net.async.capture
+CAPTURE_OPEN  = 0
+CAPTURE_RECV  = 1
+CAPTURE_SEND  = 2
+CAPTURE_CLOSE = 3
+
 def mask_str(eventmask):
     masks = []
     masks.append('WRITABLE')
@@ -0,0 +1,178 @@
+'''
+Coroutine style protocol handlers. A handler is a generator that yields the
+waiter returned by one of the reading or draining methods of a connection,
+and gets the result sent back in once it is available::
+
+    def echo(conn):
+        while True:
+            line = yield conn.read_line()
+            if line is None:
+                break
+            conn.send_line(line)
+            yield conn.drain()
+
+    server.hook('accept', lambda conn: spawn(echo(conn)))
+
+Handlers are resumed straight from the hooks that run in the dispatch loop.
+Every connection has a single waiter that is armed again for each operation,
+so waiting costs no allocation, and operations that can complete right away
+do not suspend the handler at all.
+'''
+import errno
+import os
+
+# Operations a waiter can be armed for
+LINE, EXACTLY, SOME, DRAIN = range(1, 5)
+
+# Returned by Waiter.wait when the task has to be suspended
+PENDING = object()
+
+
+class Task(object):
+    '''
+    Drives a generator, resuming it whenever the waiter it yielded completes.
+    '''
+    __slots__ = ('generator', 'done')
+
+    def __init__(self, generator):
+        self.generator = generator
+        self.done = False
+
+    def __repr__(self):
+        return '<Task %r%s>' % (self.generator, self.done and ' done' or '')
+
+    def step(self, value=None, error=None):
+        generator = self.generator
+        while True:
+            try:
+                if error is None:
+                    waiter = generator.send(value)
+                else:
+                    waiter = generator.throw(error)
+            except StopIteration:
+                self.done = True
+                return
+            except Exception:
+                self.done = True
+                raise
+
+            # Yielding None, as drain does when there is nothing to wait for,
+            # resumes right away
+            error = None
+            if waiter is None:
+                value = None
+                continue
+            try:
+                value = waiter.wait(self)
+            except EnvironmentError, error:
+                continue
+            if value is PENDING:
+                return
+
+    def close(self):
+        self.done = True
+        self.generator.close()
+
+
+def spawn(generator):
+    '''
+    Start a coroutine, it runs until it has to wait for the first time.
+    '''
+    task = Task(generator)
+    task.step()
+    return task
+
+
+class Waiter(object):
+    '''
+    The pending operation of the coroutine that is using a connection. It
+    hooks into the connection once, and completes operations as data arrives
+    or the send queue drains.
+    '''
+    __slots__ = ('conn', 'task', 'kind', 'size', 'closed')
+
+    def __init__(self, conn):
+        self.conn = conn
+        self.task = None
+        self.kind = None
+        self.size = 0
+        self.closed = False
+        conn.hook('recv', self.handle_recv)
+        conn.hook('close', self.handle_close)
+
+    def wait(self, task):
+        '''
+        The result of the armed operation if it can complete now, otherwise
+        remember the task to resume later and return PENDING.
+        '''
+        if self.task is not None:
+            raise RuntimeError('connection already has a waiting coroutine')
+        conn = self.conn
+        kind = self.kind
+        if kind == LINE:
+            line = conn.take_line()
+            if line is not None:
+                self.kind = None
+                return line
+            if self.closed:
+                self.kind = None
+                return conn.read() or None
+            if conn.is_paused('recv'):
+                # No newline within the whole receive queue, we would wait
+                # forever
+                self.kind = None
+                raise IOError(errno.EMSGSIZE, 'line exceeds receive queue')
+        elif kind == EXACTLY:
+            if conn.recv_queued >= self.size:
+                self.kind = None
+                return conn.read(self.size)
+            if self.closed:
+                self.kind = None
+                return None
+            if conn.is_paused('recv'):
+                self.kind = None
+                raise IOError(errno.EMSGSIZE, 'read exceeds receive queue')
+        elif kind == SOME:
+            if conn.recv_queued or self.closed:
+                self.kind = None
+                return conn.read() or None
+        elif kind == DRAIN:
+            if self.closed:
+                self.kind = None
+                raise IOError(errno.EPIPE, os.strerror(errno.EPIPE))
+            if conn.send_queued <= conn.watermarks['send'][0]:
+                self.kind = None
+                return True
+        self.task = task
+        return PENDING
+
+    def complete(self):
+        '''
+        Resume the waiting task if its operation can complete now.
+        '''
+        task = self.task
+        self.task = None
+        try:
+            value = self.wait(task)
+        except EnvironmentError, error:
+            task.step(None, error)
+        else:
+            if value is not PENDING:
+                task.step(value)
+
+    def handle_recv(self, conn, chunk):
+        if self.task is None or self.kind == DRAIN:
+            return
+        # Lines can only complete when one ends in this chunk, or when we
+        # have to give up because the queue is full
+        if self.kind != LINE or '\n' in chunk or conn.is_paused('recv'):
+            self.complete()
+
+    def handle_send(self):
+        if self.task is not None and self.kind == DRAIN:
+            self.complete()
+
+    def handle_close(self, conn):
+        self.closed = True
+        if self.task is not None:
+            self.complete()
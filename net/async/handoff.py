@@ -0,0 +1,212 @@
+'''
+Passing sockets between processes over AF_UNIX, with SCM_RIGHTS. A front
+process can accept connections, look at the first bytes and hand each one to
+the worker that owns it, which carries on with the connection as if it had
+accepted it itself. No byte is proxied. Listening sockets travel the same
+way, so a new process can take over from an old one without closing them::
+
+    front, worker = pair()
+    if os.fork() == 0:
+        channel = Channel(worker)
+        channel.hook('connection', serve)
+        channel.hook('listener', adopt)
+    else:
+        channel = Channel(front)
+        server.hook('accept', lambda conn: channel.handoff(conn, 'shard-1'))
+
+Every handoff is one SOCK_SEQPACKET message with the socket, a tag for the
+receiver, and whatever the sender already read from the connection. The
+receiver gets these bytes back as the first chunk of the connection.
+'''
+import errno
+import os
+import socket
+import struct
+from collections import deque
+from net.async import tcp
+from net.async.const import *
+from net.async.nonblocking import NonBlocking
+from net.family import _bare
+from net.tools import get_errno
+
+# From <asm-generic/socket.h>, Python 2 does not export these
+SO_DOMAIN = 39
+SO_ACCEPTCONN = 30
+
+# Tag length in front of every message
+HEADER = struct.Struct('!H')
+
+
+def pair():
+    '''
+    Two connected AF_UNIX sockets to build a Channel on in either process.
+    '''
+    return socket.socketpair(socket.AF_UNIX, socket.SOCK_SEQPACKET)
+
+def wrap(fd):
+    '''
+    A socket object for a descriptor we received, of whatever family and type
+    it turns out to be. Takes ownership of fd.
+    '''
+    probe = socket.fromfd(fd, socket.AF_UNIX, socket.SOCK_STREAM)
+    try:
+        family = probe.getsockopt(socket.SOL_SOCKET, SO_DOMAIN)
+        type = probe.getsockopt(socket.SOL_SOCKET, socket.SO_TYPE)
+        return socket.fromfd(fd, family, type)
+    finally:
+        probe.close()
+        os.close(fd)
+
+
+class Channel(NonBlocking):
+    '''
+    One end of a handoff channel. Sockets handed off on one end fire on the
+    other end, accepted connections as::
+
+        connection(channel, conn, tag)
+
+    with conn made by factory, and listening sockets as::
+
+        listener(channel, sock, tag)
+
+    A message that arrives truncated or without its socket is counted in
+    lost and fires error(channel, error).
+    '''
+    # Builds connections for the sockets we receive
+    factory = tcp.Client
+    # Largest message, tag and the bytes that travel along
+    max_message = 65536
+
+    def __init__(self, sock, async=None):
+        super(Channel, self).__init__(sock, None, None, async)
+        self.outgoing = deque()
+        self.sent = 0
+        self.adopted = 0
+        # Messages that lost their socket on the way, or did not fit
+        self.lost = 0
+        self.update_state()
+
+    def __repr__(self):
+        return '<handoff.Channel fd=%r>' % (self.fileno,)
+
+    @property
+    def is_reading(self):
+        return True
+
+    @property
+    def is_sending(self):
+        return bool(self.outgoing)
+
+    def handoff(self, conn, tag=''):
+        '''
+        Pass a connection, or a listening socket, to the other end. A
+        connection leaves this Multiplexer without firing its close hooks,
+        what it received so far goes along. What it has queued to send is
+        written out first, a connection that cannot take all of it right
+        now is refused with EBUSY. Our copy of the socket is closed once it
+        is on its way. A connection that cannot be handed off stays as it is.
+        '''
+        size = HEADER.size + len(tag)
+        if isinstance(conn, NonBlocking):
+            size += conn.recv_queued
+        if size > self.max_message:
+            raise IOError(errno.EMSGSIZE, os.strerror(errno.EMSGSIZE))
+
+        data = ''
+        if isinstance(conn, NonBlocking):
+            if conn.send_queued:
+                conn.handle_send()
+                if conn.send_queued:
+                    raise IOError(errno.EBUSY,
+                        'connection still has data to send')
+            if conn.recv_queued:
+                data = conn.read()
+            if conn.states is not None:
+                conn.async.unregister(conn.fileno)
+                conn.states = None
+            sock = conn.socket
+            conn.socket = None
+        else:
+            sock = conn
+        message = ''.join([HEADER.pack(len(tag)), tag, data])
+        self.outgoing.append((sock, message))
+        if len(self.outgoing) == 1:
+            self.handle_send()
+            self.update_state()
+
+    def handler(self, eventmask):
+        if not self.socket:
+            return
+        if eventmask & READABLE:
+            self.handle_recv()
+        if not self.socket:
+            return
+        if eventmask & WRITABLE:
+            self.handle_send()
+        if not self.socket:
+            return
+        if eventmask & ERROR and not eventmask & READABLE:
+            self.close()
+            return
+        self.update_state()
+
+    def handle_send(self):
+        outgoing = self.outgoing
+        while outgoing and self.socket:
+            sock, message = outgoing[0]
+            try:
+                _bare.send_fds(self.fileno, message, [sock.fileno()])
+            except EnvironmentError, e:
+                if get_errno(e) in (errno.EWOULDBLOCK, errno.EAGAIN):
+                    return
+                raise
+            outgoing.popleft()
+            sock.close()
+            self.sent += 1
+
+    def handle_recv(self):
+        while self.socket:
+            try:
+                message, fds = _bare.recv_fds(self.fileno, self.max_message, 1)
+            except EnvironmentError, e:
+                error = get_errno(e)
+                if error in (errno.EWOULDBLOCK, errno.EAGAIN):
+                    return
+                if error != errno.EMSGSIZE:
+                    raise
+                # Gone for good, the next message is fine again
+                self.lost += 1
+                self.fire('error', self, e)
+                continue
+            if not message:
+                # The other end is gone
+                for fd in fds:
+                    os.close(fd)
+                self.close()
+                return
+            if fds:
+                self.adopted += 1
+                self.adopt(wrap(fds[0]), message)
+            else:
+                self.lost += 1
+                self.fire('error', self, IOError(errno.EBADMSG,
+                    'handoff without a socket'))
+
+    def adopt(self, sock, message):
+        size = HEADER.unpack_from(message)[0]
+        tag = message[HEADER.size:HEADER.size + size]
+        data = message[HEADER.size + size:]
+        if sock.getsockopt(socket.SOL_SOCKET, SO_ACCEPTCONN):
+            self.fire('listener', self, sock, tag)
+            return
+
+        conn = self.factory(sock, async=self.async)
+        self.fire('connection', self, conn, tag)
+        if data and conn.socket:
+            conn.received(data)
+
+    def close(self):
+        # Whatever did not make it across is closed here
+        while self.outgoing:
+            self.outgoing.popleft()[0].close()
+        return super(Channel, self).close()
@@ -9,8 +9,9 @@ class Hookable(object):
         self.hook_mutex = Lock()
 
     def hook(self, group, hook, *args, **kwargs):
+        # Don't keep an empty kwargs dict around for every hook
         with self.hook_mutex:
-            self.hooks[group].append((hook, args, kwargs))
+            self.hooks[group].append((hook, args, kwargs or None))
 
     def unhook(self, group, target):
         purge = []
@@ -28,10 +29,9 @@ class Hookable(object):
         self.hooks.pop(group, None)
 
     def fire(self, group, *args_override, **kwargs_override):
-        print 'fire', group
         for hook, args, kwargs in self.hooks.get(group, []):
             args = len(args_override) and args_override or args
-            kwargs = len(kwargs_override) and kwargs_override or kwargs
+            kwargs = len(kwargs_override) and kwargs_override or kwargs or {}
             self.fire_hook(hook, *args, **kwargs)
 
     def fire_and_forget(self, group, *args_override, **kwargs_override):
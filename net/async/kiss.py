@@ -0,0 +1,188 @@
+import errno
+import fcntl
+import os
+import termios
+import tty
+from net.async.const import *
+from net.async.nonblocking import NonBlocking
+from net.family import kiss
+from net.tools import get_errno
+
+
+class Device(object):
+    '''
+    Serial port or pty, with the part of the socket interface NonBlocking
+    uses.
+    '''
+
+    def __init__(self, fd):
+        self.fd = fd
+
+    def fileno(self):
+        return self.fd
+
+    def close(self):
+        os.close(self.fd)
+
+    def setblocking(self, flag):
+        flags = fcntl.fcntl(self.fd, fcntl.F_GETFL)
+        if flag:
+            flags &= ~os.O_NONBLOCK
+        else:
+            flags |= os.O_NONBLOCK
+        fcntl.fcntl(self.fd, fcntl.F_SETFL, flags)
+
+    def recv(self, size=4096, flags=0):
+        return os.read(self.fd, size)
+
+    def send(self, string, flags=0):
+        return os.write(self.fd, string)
+
+
+class TNC(NonBlocking):
+    '''
+    KISS TNC on a serial port or pty. Data frames are handed to the frame
+    hooks as (tnc, port, frame), everything else to the command hooks as
+    (tnc, port, command, data).
+
+    Every read is decoded in one go, so a burst from the TNC costs a single
+    callback into the decoder however many frames it holds.
+    '''
+
+    def __init__(self, device, baudrate=None, maxsize=4096, async=None):
+        if isinstance(device, basestring):
+            device = os.open(device, os.O_RDWR | os.O_NOCTTY | os.O_NONBLOCK)
+        if isinstance(device, int):
+            self.configure(device, baudrate)
+            device = Device(device)
+        super(TNC, self).__init__(device, None, None, async)
+        self.decoder = kiss.Decoder(maxsize)
+        self.connected = True
+        self.connecting = False
+        self.update_state()
+
+    def __repr__(self):
+        return unicode(self)
+
+    def __unicode__(self):
+        return u'<kiss.TNC fd=%s>' % (self.fileno,)
+
+    @staticmethod
+    def configure(fd, baudrate=None):
+        '''
+        Put the line in raw mode, KISS is binary.
+        '''
+        if not os.isatty(fd):
+            return
+        tty.setraw(fd)
+        if baudrate:
+            speed = getattr(termios, 'B%d' % (baudrate,))
+            attrs = termios.tcgetattr(fd)
+            attrs[4] = attrs[5] = speed
+            termios.tcsetattr(fd, termios.TCSANOW, attrs)
+
+    def create_socket(self, family, type, proto):
+        return family
+
+    @property
+    def is_reading(self):
+        # The radio does not wait for us, so we always read
+        return True
+
+    def stats(self):
+        stats = super(TNC, self).stats()
+        stats['frames'] = self.decoder.frames
+        stats['errors'] = self.decoder.errors
+        return stats
+
+    def handler(self, eventmask):
+        if not self.socket:
+            return
+
+        try:
+            if eventmask & READABLE:
+                self.handle_recv()
+            if not self.socket:
+                return
+            if eventmask & WRITABLE:
+                self.handle_send()
+            if not self.socket:
+                return
+
+            if eventmask & ERROR and not eventmask & READABLE:
+                self.async.queue(self.close)
+                return
+
+            self.update_state()
+        except Exception, error:
+            print self, 'UNHANDLED error in handler', error
+            self.close()
+            raise
+
+    def handle_recv(self):
+        try:
+            self.recv_calls += 1
+            data = self.socket.recv(self.blocksize)
+        except EnvironmentError, e:
+            error = get_errno(e)
+            if error in (errno.EWOULDBLOCK, errno.EAGAIN):
+                return 0
+            if error == errno.EIO:
+                # The other end of the pty went away
+                data = ''
+            else:
+                raise
+
+        if not data:
+            self.close()
+            return 0
+
+        self.recv_bytes += len(data)
+        self.adapt_blocksize(len(data))
+        for port, command, frame in self.decoder.feed(data):
+            if command == kiss.DATA:
+                self.fire('frame', self, port, frame)
+            else:
+                self.fire('command', self, port, command, frame)
+        return len(data)
+
+    def send(self, data):
+        self.queue_data('send', data)
+        if self.states is not None and not self.states & WRITABLE:
+            self.update_state()
+
+    def send_frame(self, frame, port=0):
+        self.send(kiss.encode(frame, port))
+
+    def send_frames(self, frames, port=0):
+        '''
+        Send a batch of frames as a single write.
+        '''
+        if frames:
+            self.send(kiss.encode_batch(frames, port))
+
+    def set_parameter(self, command, value, port=0):
+        '''
+        Set one of the TXDELAY, PERSISTENCE, SLOTTIME, TXTAIL or FULLDUPLEX
+        parameters of the TNC.
+        '''
+        self.send(kiss.encode(chr(value & 0xff), port, command))
+
+    def handle_send(self):
+        buffer = self.send_buffer
+        if not buffer:
+            return
+
+        try:
+            chunk = buffer.pop(0)
+            self.send_calls += 1
+            size = self.socket.send(chunk)
+            self.send_bytes += size
+            if size < len(chunk):
+                buffer.insert(0, chunk[size:])
+            self.dequeue_data('send', size)
+        except EnvironmentError, e:
+            if get_errno(e) in (errno.EWOULDBLOCK, errno.EAGAIN):
+                buffer.insert(0, chunk)
+                return
+            raise
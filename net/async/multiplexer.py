@@ -1,14 +1,20 @@
 from __future__ import with_statement
 import errno
+import heapq
+import itertools
+import math
 import os
 import select as select
 import socket
+import time
 import warnings
-from collections import defaultdict
-from Queue import Queue
+from collections import defaultdict, deque
+from Queue import Empty, Queue
 from threading import Lock
+from net.async.buffers import BufferPool
 from net.async.const import *
 from net.async.hookable import Hookable
+from net.async.stats import Exporter, LoopStats
 from net.tools import get_errno
 
 # For Python < 2.6
@@ -20,20 +26,52 @@ try:
     from net.async import _kqueue
 except ImportError:
     _kqueue = None
+try:
+    from net.family import _bare
+except ImportError:
+    _bare = None
 
 
 class Multiplexer(Hookable):
     '''
     Fast socket multiplexer.
-    '''
 
-    def __init__(self):
+    Ready descriptors are dispatched in the order they became ready, class by
+    class in priority order. Each class dispatches at most its budget of
+    descriptors per loop iteration, the rest is carried over to the next
+    iteration and keeps its place in line.
+    '''
+    # Most descriptors dispatched per priority class in one loop iteration
+    budgets = {
+        PRIORITY_DATA: 1024,
+        PRIORITY_LISTENER: 64,
+    }
+    budget = 1024
+    # Seconds to keep polling without blocking before the poll may sleep,
+    # trading a CPU for the wakeup latency of the sleep. 0 blocks right away.
+    spin = 0.0
+
+    def __init__(self, poller=None):
         super(Multiplexer, self).__init__()
-        self.poller = Multiplexer.detect()
+        self.poller = poller or Multiplexer.detect()
         self.running = False
         self.queued = Queue()
         self.queued_mutex = Lock()
+        # Event masks of ready descriptors, and the order to dispatch them in
+        # per priority class
         self.unhandled = dict()
+        self.ready = {}
+        self.classes = []
+        self.priorities = {}
+        # Connections with sends queued since the last flush
+        self.dirty = []
+        # Heap of (when, sequence, callback, args, kwargs) for later
+        self.timers = []
+        self.sequence = itertools.count()
+        self.buffers = BufferPool()
+        self.statistics = LoopStats()
+        self.exporter = None
+        self.export_interval = 1.0
 
     @staticmethod
     def detect():
@@ -59,8 +97,13 @@ class Multiplexer(Hookable):
             Multiplexer._instance = Multiplexer()
         return Multiplexer._instance
 
-    def register(self, fd, callback, eventmask):
+    def register(self, fd, callback, eventmask, priority=PRIORITY_DATA):
         self.hook(fd, callback)
+        if priority != PRIORITY_DATA:
+            self.priorities[fd] = priority
+        if not priority in self.ready:
+            self.ready[priority] = deque()
+            self.classes = sorted(self.ready)
         eventmask |= ERROR
         self.poller.register(fd, eventmask)
         return self
@@ -72,7 +115,9 @@ class Multiplexer(Hookable):
 
     def unregister(self, fd):
         self.unhook_group(fd)
+        # Stale entries in the ready queues are skipped when dispatching
         self.unhandled.pop(fd, None)
+        self.priorities.pop(fd, None)
         try:
             self.poller.unregister(fd)
         except (IOError, OSError):
@@ -88,16 +133,141 @@ class Multiplexer(Hookable):
             self.queued.put((callback, args, kwargs))
         return self
 
+    def later(self, delay, callback, *args, **kwargs):
+        '''
+        Call a callback from the event loop once delay seconds have passed.
+        Unlike queue, only the thread running the loop may use this.
+        '''
+        heapq.heappush(self.timers, (time.time() + delay, next(self.sequence),
+            callback, args, kwargs))
+        return self
+
     def stop(self):
         self.running = False
         return self
 
-    def run(self, timeout=0.2):
-        queued = []
-        events = dict()
+    def stats(self, connections=False, top=10):
+        '''
+        Snapshot of the event loop counters, including those kept by the
+        poller and socket extensions if they are in use. With connections, the
+        per connection byte and system call counters are included as well.
+        '''
+        result = self.statistics.snapshot(top)
+        result['fds'] = len(self.hooks)
+        if isinstance(self.poller, _epoll_like_epoll):
+            result['_epoll'] = _epoll.stats()
+        if _bare:
+            result['_bare'] = _bare.stats()
+
+        if connections:
+            result['connections'] = conns = {}
+            for fd, hooks in self.hooks.items():
+                for hook, args, kwargs in hooks:
+                    conn = getattr(hook, 'im_self', None)
+                    if hasattr(conn, 'stats'):
+                        conns[fd] = conn.stats()
+        return result
+
+    def export(self, path, interval=1.0):
+        '''
+        Publish a stats snapshot in the memory mapped file at path every
+        interval seconds while running, read it with stats.read_export.
+        '''
+        if self.exporter:
+            self.exporter.close()
+        self.exporter = Exporter(path)
+        self.export_interval = interval
+        self.exporter.write(self.stats())
+        return self
+
+    def schedule(self, events):
+        '''
+        Queue ready descriptors for dispatch. Descriptors that are still
+        queued from an earlier iteration keep their place.
+        '''
+        unhandled = self.unhandled
+        priorities = self.priorities
+        ready = self.ready
+        for fd, eventmask in events:
+            if fd in unhandled:
+                unhandled[fd] |= eventmask
+            else:
+                unhandled[fd] = eventmask
+                ready[priorities.get(fd, PRIORITY_DATA)].append(fd)
+
+    def flush(self):
+        '''
+        Write out the sends that were queued since the last flush, one
+        gathered write per connection.
+        '''
+        dirty = self.dirty
+        if dirty:
+            self.dirty = []
+            for conn in dirty:
+                conn.flush()
+
+    def dispatch(self, fd, eventmask):
+        try:
+            self.fire(fd, eventmask)
+        except (IOError, OSError), error:
+            errnum = get_errno(error)
+            if errnum in (errno.EPIPE,):
+                # Client is gone, this will raise a READABLE event next
+                # returning a zero-length chunk so we'll handle it there
+                pass
+            else:
+                raise
+        except Exception, e:
+            warnings.warn('Unhandled exception from hook %r' % \
+                (self.hooks[fd],))
+            raise
+
+    def poll(self, timeout):
+        '''
+        Wait for events, busy polling for up to spin seconds first. The _epoll
+        extension spins without the GIL, other pollers spin here.
+        '''
+        spin = self.spin
+        poller = self.poller
+        if spin <= 0 or timeout == 0:
+            return poller.poll(timeout)
+        if isinstance(poller, _epoll_like_epoll):
+            return poller.poll(timeout, spin=spin)
+
+        poll = poller.poll
+        now = time.time
+        stats = self.statistics
+        deadline = now() + spin
+        while True:
+            stats.spins += 1
+            events = poll(0)
+            if events:
+                stats.spin_hits += 1
+                return events
+            if now() >= deadline:
+                break
+        if timeout > 0:
+            timeout = max(0.0, timeout - spin)
+            if timeout == 0:
+                return events
+        return poll(timeout)
+
+    def run(self, timeout=0.2, spin=None):
+        '''
+        Run the event loop until stopped, polling with the given timeout in
+        seconds. A spin in seconds turns on busy polling, see spin.
+        '''
+        if spin is not None:
+            self.spin = spin
+        queued = deque()
+        stats = self.statistics
+        now = time.time
+        exported = now()
+        unhandled = self.unhandled
         self.running = True
         while self.running:
             wait = timeout
+            stats.iterations += 1
 
             if self.queued.qsize():
                 with self.queued_mutex:
@@ -107,33 +277,63 @@ class Multiplexer(Hookable):
                         except Empty:
                             break
 
+            stats.queued(len(queued))
             while queued:
-                hook, args, kwargs = queued.pop(0)
+                hook, args, kwargs = queued.popleft()
+                start = now()
                 self.fire_hook(hook, *args, **kwargs)
-
-            # If we get new callbacks in the mean time, make sure we don't
-            # delay in the next poll
-            if self.queued.qsize():
+                stats.called(hook, now() - start)
+
+            timers = self.timers
+            if timers:
+                due = now()
+                while timers and timers[0][0] <= due:
+                    when, sequence, hook, args, kwargs = heapq.heappop(timers)
+                    start = now()
+                    self.fire_hook(hook, *args, **kwargs)
+                    stats.called(hook, now() - start)
+                # Wake up in time for the next one, pollers that count in
+                # milliseconds would not wait at all for less than that
+                if timers:
+                    delay = max(0.0, timers[0][0] - now())
+                    if 0 < delay < 0.001:
+                        delay = 0.001
+                    if wait < 0 or delay < wait:
+                        wait = delay
+            self.flush()
+
+            # If we get new callbacks or have descriptors left over in the
+            # mean time, make sure we don't delay in the next poll
+            if self.queued.qsize() or unhandled or self.dirty:
                 wait = 0.0
 
-            self.unhandled.update(self.poller.poll(wait))
-            while self.unhandled:
-                fd, eventmask = self.unhandled.popitem()
-                try:
-                    self.fire(fd, eventmask)
-                except (IOError, OSError), error:
-                    errnum = get_errno(error)
-                    if errnum in (errno.EPIPE,):
-                        # Client is gone, this will raise a READABLE event
-                        # next returning a zero-length chunk so we'll handle
-                        # it there
-                        pass
-                    else:
-                        raise
-                except Exception, e:
-                    warnings.warn('Unhandled exception from hook %r' % \
-                        (self.hooks[fd],))
-                    raise
+            start = now()
+            events = self.poll(wait)
+            dispatch = now()
+            stats.polled(dispatch - start, len(events))
+
+            self.schedule(events)
+            for priority in self.classes:
+                fds = self.ready[priority]
+                for x in xrange(min(len(fds),
+                    self.budgets.get(priority, self.budget))):
+                    fd = fds.popleft()
+                    eventmask = unhandled.pop(fd, None)
+                    if eventmask is None:
+                        continue
+                    hooks = self.hooks.get(fd)
+                    start = now()
+                    self.dispatch(fd, eventmask)
+                    if hooks:
+                        stats.called(hooks[0][0], now() - start)
+            self.flush()
+
+            finished = now()
+            stats.dispatched(finished - dispatch)
+            stats.carried(len(unhandled))
+            if self.exporter and finished - exported >= self.export_interval:
+                self.exporter.write(self.stats())
+                exported = finished
 
 
 class kqueue_like_epoll(object):
@@ -219,11 +419,19 @@ class _epoll_like_epoll(object):
         _epoll.control(self.epollfd, _epoll.EPOLL_CTL_MOD, fd, eventmask)
 
     def unregister(self, fd):
-        _epoll.control(self.epollfd, _epoll.EPOLL_CTL_DEL, fd, eventmask)
+        _epoll.control(self.epollfd, _epoll.EPOLL_CTL_DEL, fd, 0)
 
-    def poll(self, timeout=0, maxevents=1024):
-        timeout = min(timeout, 0)
-        return _epoll.wait(self.epollfd, int(timeout * 1000))
+    def poll(self, timeout=-1, maxevents=1024, spin=0):
+        # epoll_wait takes milliseconds, negative blocks forever. Rounded up,
+        # so a wait of less than a millisecond does not turn into a busy loop
+        if timeout < 0:
+            timeout = -1
+        else:
+            timeout = int(math.ceil(timeout * 1000))
+        if spin > 0:
+            return _epoll.wait(self.epollfd, timeout, maxevents,
+                int(spin * 1e6))
+        return _epoll.wait(self.epollfd, timeout, maxevents)
 
 
 class select_like_epoll(object):
@@ -247,7 +455,6 @@ class select_like_epoll(object):
             self.fds['writable'].add(fd)
         if eventmask & ERROR:
             self.fds['error'].add(fd)
-            self.fds['readble'].add(fd)
 
     def modify(self, fd, eventmask):
         self.unregister(fd)
@@ -258,6 +465,9 @@ class select_like_epoll(object):
             self.fds[group].discard(fd)
 
     def poll(self, timeout=-1, maxevents=-1):
+        # select blocks forever on None, not on negative timeouts
+        if timeout < 0:
+            timeout = None
         readable, writable, errors = select.select(
             self.fds['readable'],
             self.fds['writable'],
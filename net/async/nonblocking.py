@@ -1,11 +1,32 @@
 import socket
-from collections import defaultdict
+from net.async.connection import Connection
 from net.async.const import *
-from net.async.hookable import Hookable
 from net.async.multiplexer import Multiplexer
 
 
-class NonBlocking(Hookable):
+class NonBlocking(Connection):
+    # Queue watermarks in bytes as (low, high); crossing high fires the pause
+    # hook, draining below low fires the resume hook.
+    watermarks = {
+        'recv': (16384, 65536),
+        'send': (16384, 65536),
+    }
+    # Hard cap on the number of bytes waiting in the send queue
+    send_limit = 262144
+    # Bounds for the adaptive read size
+    min_blocksize = 512
+    max_blocksize = 262144
+    # Size reads by asking the kernel how much is waiting (FIONREAD), this
+    # costs an extra system call per read
+    fionread = False
+    # Dispatch priority class in the Multiplexer
+    priority = PRIORITY_DATA
+    # Busy poll the device queue for up to this many microseconds on reads
+    # (SO_BUSY_POLL), raising it above the system default takes
+    # CAP_NET_ADMIN. 0 leaves the socket alone.
+    busy_poll = 0
+    prefer_busy_poll = False
+
     def __init__(self, family, type, proto, async=None):
         '''
         Create a new non blocking socket and connect it to the async. You
@@ -22,29 +43,42 @@ class NonBlocking(Hookable):
             >>> s.connect(('localhost', 23))
             >>> n = NonBlocking(s)
 
+        All state lives in Connection, so instances don't need a __dict__
+        until someone attaches attributes of their own.
+
+        Received data is only queued while the recv hooks run, so they can
+        read() it, and whatever they leave is consumed. Set retain to keep
+        it queued until it is read, for consumers that wait for more to
+        arrive. Coroutine waiters do so themselves.
         '''
         super(NonBlocking, self).__init__()
         self.async = async or Multiplexer.shared()
-        if isinstance(family, socket.socket):
-            self.socket = family
+        if isinstance(family, (socket.socket, socket._realsocket)):
+            # Keep the bare socket, the wrapper costs several objects each
+            self.socket = getattr(family, '_sock', family)
         else:
             self.socket = self.create_socket(family, type, proto)
 
         # Non-blocking socket please
         self.socket.setblocking(False)
+        if self.busy_poll:
+            self.set_busy_poll(self.busy_poll, self.prefer_busy_poll)
 
-        # Data structs to keep track of stuff
-        self.blocksize = 4096
-        self.states = None
-        self.buffer = defaultdict(list)
-
-    @property
-    def is_reading(self):
-        return bool(self.hooks.get('recv', False))
-
-    @property
-    def is_sending(self):
-        return bool(self.buffer.get('send', False))
+    def set_busy_poll(self, usecs, prefer=False):
+        '''
+        Apply SO_BUSY_POLL, and SO_PREFER_BUSY_POLL with prefer, to our
+        socket. Plain sockets take the options from Python, so this does not
+        depend on any extension being built.
+        '''
+        sock = self.socket
+        if hasattr(sock, 'setsockopt'):
+            sock.setsockopt(socket.SOL_SOCKET, SO_BUSY_POLL, usecs)
+            if prefer:
+                sock.setsockopt(socket.SOL_SOCKET, SO_PREFER_BUSY_POLL, 1)
+        elif hasattr(sock, 'busy_poll'):
+            # net.family.bare sockets have no setsockopt
+            sock.busy_poll(usecs, prefer)
+        # A serial line has no device queue to poll
 
     def close(self):
         if self.fileno is not None:
@@ -55,15 +89,57 @@ class NonBlocking(Hookable):
             self.fire('close', self)
         return self
 
-    def create_socket(self, family, type, proto):
-        return socket.socket(family, type, proto)
+    def stats(self):
+        return {
+            'recv_calls': self.recv_calls,
+            'recv_bytes': self.recv_bytes,
+            'send_calls': self.send_calls,
+            'send_bytes': self.send_bytes,
+            'recv_queued': self.recv_queued,
+            'send_queued': self.send_queued,
+            'blocksize': self.blocksize,
+        }
+
+    def received(self, data):
+        '''
+        Queue received data and hand it to the recv hooks.
+        '''
+        retain = self.retain
+        self.queue_data('recv', data, retain)
+        self.fire('recv', self, data)
+        if not retain and self.recv_queued:
+            # Handed to the hooks, what they did not read is consumed
+            self.read()
+
+    def hook(self, group, hook, *args, **kwargs):
+        super(NonBlocking, self).hook(group, hook, *args, **kwargs)
+        # We may have to start reading
+        if group == 'recv' and self.states is not None:
+            self.update_state()
+
+    def adapt_blocksize(self, size):
+        '''
+        Grow the read size when a read filled the whole block, shrink it when
+        reads only use a fraction of it.
+        '''
+        if size >= self.blocksize:
+            self.blocksize = min(self.blocksize << 1, self.max_blocksize)
+        elif size < self.blocksize >> 2:
+            self.blocksize = max(self.blocksize >> 1, self.min_blocksize)
 
-    @property
-    def fileno(self):
-        if self.socket:
-            return self.socket.fileno()
-        else:
-            return None
+    def set_watermarks(self, queue, low, high):
+        '''
+        Configure the low and high watermark of the ``recv`` or ``send`` queue
+        for this connection only.
+        '''
+        if not 0 <= low < high:
+            raise ValueError('low watermark must be below high watermark')
+        self.watermarks = dict(self.watermarks)
+        self.watermarks[queue] = (low, high)
+        return self
+
+    def create_socket(self, family, type, proto):
+        return socket._realsocket(family, type, proto)
 
     def set_state(self, state):
         if self.socket is None:
@@ -71,11 +147,32 @@ class NonBlocking(Hookable):
 
         if self.states is None:
             self.states = state | ERROR
-            self.async.register(self.fileno, self.handler, self.states)
+            self.async.register(self.fileno, self.handler, self.states,
+                self.priority)
         else:
             self.states |= state
             self.async.update(self.fileno, self.states)
 
+    def update_state(self):
+        '''
+        Bring our interest in the Multiplexer in line with our queues.
+        '''
+        if self.socket is None:
+            return
+
+        states = ERROR
+        if self.is_reading:
+            states |= READABLE
+        if self.is_sending:
+            states |= WRITABLE
+        if self.states is None:
+            self.states = states
+            self.async.register(self.fileno, self.handler, self.states,
+                self.priority)
+        elif states != self.states:
+            self.states = states
+            self.async.update(self.fileno, self.states)
+
     def run(self, callback=None):
         if not self.connected:
             self.connect(self.address, callback=callback)
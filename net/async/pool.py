@@ -0,0 +1,238 @@
+'''
+Persistent client connections, kept idle per address for reuse::
+
+    pool = Pool(async)
+
+    def ready(conn, error):
+        if error is None:
+            conn.hook('recv', ...)
+            conn.send(request)
+        # ... and once the response is in
+        pool.checkin(conn)
+
+    pool.checkout(('10.0.0.1', 80), ready)
+
+A connection that is checked in gets its hooks and receive queue reset, and
+is kept while it stays healthy: the Multiplexer keeps watching it, so a peer
+that closes or talks out of turn gets it dropped, and every check_interval
+the idle ones are looked at and topped up to min_idle per address.
+'''
+import errno
+import os
+import socket
+import time
+from functools import partial
+from net.async import tcp
+from net.async.multiplexer import Multiplexer
+from net.tools import get_errno
+
+
+class Pool(object):
+    # Idle connections to keep per address, at least and at most
+    min_idle = 0
+    max_idle = 8
+    # Seconds an idle connection beyond min_idle is kept around
+    idle_timeout = 60.0
+    # Seconds between health checks of the idle connections
+    check_interval = 5.0
+    # Called as factory(address, async=async) for new connections
+    factory = tcp.Client
+
+    def __init__(self, async=None, min_idle=None, max_idle=None):
+        self.async = async or Multiplexer.shared()
+        if min_idle is not None:
+            self.min_idle = min_idle
+        if max_idle is not None:
+            self.max_idle = max_idle
+        # address: [conn, ...] most recently checked in last
+        self.idle = {}
+        # conn: when it was checked in, for the idle ones
+        self.since = {}
+        # conn: callback, for connects in flight
+        self.connecting = {}
+        # address: connects in flight to top up min_idle
+        self.opening = {}
+        self.checking = False
+        self.hits = 0
+        self.misses = 0
+        self.opened = 0
+        self.failed = 0
+        self.discarded = 0
+        self.expired = 0
+
+    def checkout(self, address, callback):
+        '''
+        Get a connected connection to address, calling callback(conn, None)
+        once there is one or callback(None, error) if connecting failed.
+        Idle connections are handed out right away.
+        '''
+        idle = self.idle.setdefault(address, [])
+        while idle:
+            conn = idle.pop()
+            del self.since[conn]
+            self.release(conn)
+            if self.healthy(conn):
+                self.hits += 1
+                if len(idle) < self.min_idle:
+                    self.async.queue(self.replenish, address)
+                callback(conn, None)
+                return
+            conn.close()
+            self.discarded += 1
+
+        self.misses += 1
+        self.open(address, callback)
+        self.schedule()
+
+    def checkin(self, conn):
+        '''
+        Hand a connection back. It is closed instead of kept when it is not
+        connected, still has data to send, or there are enough idle ones.
+        '''
+        # Connections keep the address they were made for
+        idle = self.idle.setdefault(conn.address, [])
+        if not conn.socket or conn.connecting or conn.send_queued \
+            or len(idle) >= self.max_idle:
+            conn.close()
+            self.discarded += 1
+            return
+
+        self.reset(conn)
+        self.since[conn] = time.time()
+        conn.hook('recv', self.handle_idle_recv)
+        conn.hook('close', self.handle_idle_close)
+        idle.append(conn)
+        self.schedule()
+
+    def open(self, address, callback):
+        conn = self.factory(address, async=self.async)
+        self.connecting[conn] = callback
+        conn.hook('connect', self.handle_connect)
+        conn.hook('error', self.handle_error)
+        conn.hook('close', self.handle_abort)
+        try:
+            conn.connect()
+        except EnvironmentError, error:
+            self.handle_error(conn, error)
+            conn.close()
+
+    def reset(self, conn):
+        '''
+        Forget what the last user left behind: hooks, a coroutine waiter and
+        anything still in the receive queue, which it no longer retains.
+        '''
+        for group in conn.hooks.keys():
+            conn.unhook_group(group)
+        conn.waiter = None
+        conn.retain = False
+        if conn.recv_queued:
+            conn.read()
+        conn.update_state()
+
+    def release(self, conn):
+        conn.unhook_group('recv')
+        conn.unhook_group('close')
+
+    def healthy(self, conn):
+        '''
+        An idle connection is fit for reuse when the peer neither closed it
+        nor sent anything, peeking tells without taking data.
+        '''
+        if not conn.socket:
+            return False
+        try:
+            conn.socket.recv(1, socket.MSG_PEEK)
+        except socket.error, e:
+            return get_errno(e) in (errno.EAGAIN, errno.EWOULDBLOCK)
+        return False
+
+    def replenish(self, address):
+        idle = self.idle.get(address, [])
+        while len(idle) + self.opening.get(address, 0) < self.min_idle:
+            self.opening[address] = self.opening.get(address, 0) + 1
+            self.open(address, partial(self.handle_replenished, address))
+
+    def schedule(self):
+        if not self.checking:
+            self.checking = True
+            self.async.later(self.check_interval, self.check)
+
+    def check(self):
+        '''
+        Drop idle connections that went bad or were not needed for
+        idle_timeout, and top every address up to min_idle.
+        '''
+        self.checking = False
+        now = time.time()
+        for address, idle in self.idle.items():
+            for conn in list(idle):
+                if not self.healthy(conn):
+                    self.discarded += 1
+                elif len(idle) > self.min_idle \
+                    and now - self.since[conn] >= self.idle_timeout:
+                    self.expired += 1
+                else:
+                    continue
+                idle.remove(conn)
+                del self.since[conn]
+                self.release(conn)
+                conn.close()
+            self.replenish(address)
+        if self.min_idle or any(self.idle.itervalues()) or self.opening:
+            self.schedule()
+
+    def close(self):
+        for idle in self.idle.itervalues():
+            while idle:
+                conn = idle.pop()
+                self.release(conn)
+                conn.close()
+        self.since.clear()
+
+    def handle_connect(self, conn):
+        callback = self.connecting.pop(conn)
+        self.opened += 1
+        self.reset(conn)
+        callback(conn, None)
+
+    def handle_error(self, conn, error):
+        callback = self.connecting.pop(conn, None)
+        if callback is not None:
+            self.failed += 1
+            callback(None, error)
+
+    def handle_abort(self, conn):
+        # Closed before it got connected, without an error of its own
+        self.handle_error(conn, socket.error(errno.ECONNABORTED,
+            os.strerror(errno.ECONNABORTED)))
+
+    def handle_replenished(self, address, conn, error):
+        self.opening[address] -= 1
+        if conn is not None:
+            self.checkin(conn)
+
+    def handle_idle_recv(self, conn, chunk):
+        # Nobody asked, whatever the peer is up to we cannot reuse this
+        self.handle_idle_close(conn)
+        conn.close()
+
+    def handle_idle_close(self, conn):
+        idle = self.idle.get(conn.address, ())
+        if conn in idle:
+            idle.remove(conn)
+            del self.since[conn]
+            self.discarded += 1
+
+    def stats(self):
+        checkouts = self.hits + self.misses
+        hit_rate = checkouts and self.hits / float(checkouts) or 0.0
+        return {
+            'hits': self.hits,
+            'misses': self.misses,
+            'hit_rate': round(hit_rate, 4),
+            'opened': self.opened,
+            'failed': self.failed,
+            'discarded': self.discarded,
+            'expired': self.expired,
+            'idle': sum(len(idle) for idle in self.idle.itervalues()),
+        }
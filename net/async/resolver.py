@@ -0,0 +1,179 @@
+'''
+Host name resolution off the event loop. getaddrinfo runs on a few worker
+threads, the answers are handed back through the queue of the Multiplexer that
+asked for them, so callbacks run in the event loop like any other hook::
+
+    def resolved(addresses, error):
+        ...
+
+    Resolver.shared().resolve(async, 'example.org', 80, resolved)
+
+Addresses are (family, sockaddr) pairs in Happy Eyeballs order (RFC 8305):
+the family the system prefers first, then alternating between families.
+
+Answers are cached for ttl seconds and failures for negative_ttl seconds.
+getaddrinfo does not tell the TTL of the records it found, so these are ours
+to pick. The lookup function can be swapped for a stub, everything else works
+from /etc/hosts.
+'''
+from __future__ import with_statement
+import socket
+import threading
+import time
+from Queue import Queue
+
+
+def numeric(host):
+    '''
+    The family of a numeric host address, or None if it has to be looked up.
+    '''
+    for family in (socket.AF_INET, socket.AF_INET6):
+        try:
+            socket.inet_pton(family, host)
+        except (socket.error, ValueError):
+            continue
+        return family
+    return None
+
+def interleave(addresses):
+    '''
+    Order (family, sockaddr) pairs to alternate between families, keeping
+    the order within each family and starting with the first family seen.
+    '''
+    families = []
+    grouped = {}
+    for address in addresses:
+        group = grouped.get(address[0])
+        if group is None:
+            group = grouped[address[0]] = []
+            families.append(group)
+        group.append(address)
+
+    result = []
+    while families:
+        for group in families:
+            result.append(group.pop(0))
+        families = [group for group in families if group]
+    return result
+
+
+class Resolver(object):
+    # Seconds to cache answers and failures for
+    ttl = 60.0
+    negative_ttl = 5.0
+    # Expired entries are dropped when the cache fills up, everything goes
+    # when that was not enough
+    max_entries = 4096
+
+    _instance = None
+
+    def __init__(self, workers=2, getaddrinfo=None):
+        self.workers = workers
+        self.getaddrinfo = getaddrinfo or socket.getaddrinfo
+        self.requests = Queue()
+        self.threads = []
+        # (host, port): (expires, addresses, error)
+        self.cache = {}
+        # (host, port): [(async, callback), ...] waiting for a lookup
+        self.pending = {}
+        self.mutex = threading.Lock()
+        self.hits = 0
+        self.misses = 0
+        self.lookups = 0
+
+    @staticmethod
+    def shared():
+        if Resolver._instance is None:
+            Resolver._instance = Resolver()
+        return Resolver._instance
+
+    def resolve(self, async, host, port, callback):
+        '''
+        Look up host, and call callback(addresses, error) from the event loop
+        of async. Numeric addresses and cached answers are answered right
+        away, lookups for the same host and port are shared.
+        '''
+        family = numeric(host)
+        if family is not None:
+            callback([(family, (host, port))], None)
+            return
+
+        key = (host, port)
+        with self.mutex:
+            entry = self.cache.get(key)
+            if entry is not None and entry[0] <= time.time():
+                del self.cache[key]
+                entry = None
+            if entry is None:
+                self.misses += 1
+                waiting = self.pending.get(key)
+                if waiting is None:
+                    self.pending[key] = [(async, callback)]
+                    self.lookup(async, key)
+                else:
+                    waiting.append((async, callback))
+                return
+            self.hits += 1
+        callback(entry[1], entry[2])
+
+    def lookup(self, async, key):
+        # Workers start with the first lookup, so nothing runs in processes
+        # that never need one
+        if len(self.threads) < self.workers:
+            thread = threading.Thread(target=self.work,
+                name='resolver-%d' % (len(self.threads),))
+            thread.daemon = True
+            thread.start()
+            self.threads.append(thread)
+        self.requests.put((async, key))
+
+    def work(self):
+        while True:
+            async, key = self.requests.get()
+            addresses = error = None
+            try:
+                addresses = interleave([(info[0], info[4]) for info in
+                    self.getaddrinfo(key[0], key[1], 0, socket.SOCK_STREAM)])
+            except Exception, error:
+                pass
+            async.queue(self.resolved, async, key, addresses, error)
+
+    def resolved(self, async, key, addresses, error):
+        with self.mutex:
+            self.lookups += 1
+            cache = self.cache
+            if len(cache) >= self.max_entries:
+                now = time.time()
+                for name, entry in cache.items():
+                    if entry[0] <= now:
+                        del cache[name]
+                if len(cache) >= self.max_entries:
+                    cache.clear()
+            if error is None:
+                expires = time.time() + self.ttl
+            else:
+                expires = time.time() + self.negative_ttl
+            cache[key] = (expires, addresses, error)
+            waiting = self.pending.pop(key, ())
+
+        for other, callback in waiting:
+            if other is async:
+                callback(addresses, error)
+            else:
+                other.queue(callback, addresses, error)
+
+    def flush(self):
+        '''
+        Forget all cached answers.
+        '''
+        with self.mutex:
+            self.cache.clear()
+
+    def stats(self):
+        return {
+            'hits': self.hits,
+            'misses': self.misses,
+            'lookups': self.lookups,
+            'entries': len(self.cache),
+            'pending': len(self.pending),
+        }
@@ -0,0 +1,266 @@
+import json
+import mmap
+import os
+import struct
+import time
+
+# Native histograms, with a pure Python fallback
+try:
+    from net.async import _stats
+except ImportError:
+    _stats = None
+
+
+class PyHistogram(object):
+    '''
+    Log bucketed histogram with the same buckets as the _stats extension,
+    used when it is not available.
+    '''
+    SUB_BITS = 3
+
+    def __init__(self):
+        self.reset()
+
+    @property
+    def count(self):
+        return self.total
+
+    def reset(self):
+        self.buckets = {}
+        self.total = 0
+        self.sum = 0
+        self.min = 0
+        self.max = 0
+
+    def index(self, value):
+        if value < 1 << self.SUB_BITS:
+            return value
+        shift = value.bit_length() - 1 - self.SUB_BITS
+        return ((shift + 1) << self.SUB_BITS) \
+            | ((value >> shift) & ((1 << self.SUB_BITS) - 1))
+
+    def upper(self, index):
+        if index < 1 << self.SUB_BITS:
+            return index
+        shift = (index >> self.SUB_BITS) - 1
+        sub = index & ((1 << self.SUB_BITS) - 1)
+        return ((((1 << self.SUB_BITS) | sub) + 1) << shift) - 1
+
+    def record(self, value):
+        value = max(0, int(value))
+        if not self.total or value < self.min:
+            self.min = value
+        if value > self.max:
+            self.max = value
+        self.total += 1
+        self.sum += value
+        index = self.index(value)
+        self.buckets[index] = self.buckets.get(index, 0) + 1
+
+    def percentile(self, percentile):
+        if not self.total:
+            return 0
+        wanted = max(1, int(self.total * percentile / 100.0 + 0.5))
+        seen = 0
+        for index in sorted(self.buckets):
+            seen += self.buckets[index]
+            if seen >= wanted:
+                return min(self.upper(index), self.max)
+        return self.max
+
+    def snapshot(self):
+        result = {
+            'count': self.total,
+            'sum': self.sum,
+            'min': self.min,
+            'max': self.max,
+            'buckets': [(self.upper(index), self.buckets[index])
+                for index in sorted(self.buckets)],
+        }
+        for percentile in (50, 90, 99, 99.9):
+            result['p%s' % (percentile,)] = self.percentile(percentile)
+        return result
+
+
+if _stats:
+    Histogram = _stats.Histogram
+else:
+    Histogram = PyHistogram
+
+
+def hook_name(hook):
+    '''
+    Readable name for a hook function or bound method.
+    '''
+    name = getattr(hook, '__name__', repr(hook))
+    owner = getattr(hook, 'im_class', None)
+    if owner is not None:
+        name = '%s.%s' % (owner.__name__, name)
+    module = getattr(hook, '__module__', None)
+    if module:
+        name = '%s.%s' % (module, name)
+    return name
+
+
+class LoopStats(object):
+    '''
+    Always-on counters of a Multiplexer event loop. Durations are recorded in
+    microseconds.
+    '''
+
+    def __init__(self):
+        self.started = time.time()
+        self.iterations = 0
+        self.wakeups = 0
+        self.events = 0
+        self.callbacks = 0
+        self.queue_depth = 0
+        self.queue_depth_max = 0
+        self.poll_us = 0
+        self.dispatch_us = 0
+        # Ready descriptors left for the next iteration by dispatch budgets
+        self.carryover = 0
+        self.carryover_max = 0
+        # Non-blocking polls made while busy polling, and the polls they served
+        self.spins = 0
+        self.spin_hits = 0
+        self.histograms = {
+            'poll_us': Histogram(),
+            'dispatch_us': Histogram(),
+            'callback_us': Histogram(),
+            'events_per_wakeup': Histogram(),
+        }
+        # Per hook function: [calls, total microseconds, slowest]
+        self.hooks = {}
+
+    def queued(self, depth):
+        self.queue_depth = depth
+        if depth > self.queue_depth_max:
+            self.queue_depth_max = depth
+
+    def polled(self, elapsed, events):
+        elapsed = int(elapsed * 1e6)
+        self.poll_us += elapsed
+        self.histograms['poll_us'].record(elapsed)
+        if events:
+            self.wakeups += 1
+            self.events += events
+            self.histograms['events_per_wakeup'].record(events)
+
+    def dispatched(self, elapsed):
+        elapsed = int(elapsed * 1e6)
+        self.dispatch_us += elapsed
+        self.histograms['dispatch_us'].record(elapsed)
+
+    def carried(self, count):
+        self.carryover += count
+        if count > self.carryover_max:
+            self.carryover_max = count
+
+    def called(self, hook, elapsed):
+        elapsed = int(elapsed * 1e6)
+        self.callbacks += 1
+        self.histograms['callback_us'].record(elapsed)
+        # Aggregate bound methods by their function and class
+        func = getattr(hook, 'im_func', None)
+        key = func is None and hook or (func, hook.im_class)
+        counters = self.hooks.get(key)
+        if counters is None:
+            counters = self.hooks[key] = [0, 0, 0, hook_name(hook)]
+        counters[0] += 1
+        counters[1] += elapsed
+        if elapsed > counters[2]:
+            counters[2] = elapsed
+
+    def snapshot(self, top=10):
+        slowest = sorted(self.hooks.itervalues(), key=lambda item: item[2],
+            reverse=True)[:top]
+        return {
+            'uptime': round(time.time() - self.started, 3),
+            'iterations': self.iterations,
+            'wakeups': self.wakeups,
+            'events': self.events,
+            'callbacks': self.callbacks,
+            'queue_depth': self.queue_depth,
+            'queue_depth_max': self.queue_depth_max,
+            'poll_us': self.poll_us,
+            'dispatch_us': self.dispatch_us,
+            'carryover': self.carryover,
+            'carryover_max': self.carryover_max,
+            'spins': self.spins,
+            'spin_hits': self.spin_hits,
+            'histograms': dict((name, histogram.snapshot())
+                for name, histogram in self.histograms.iteritems()),
+            'slowest_hooks': [{
+                'hook': name,
+                'calls': calls,
+                'total_us': total,
+                'max_us': slowest,
+            } for calls, total, slowest, name in slowest],
+        }
+
+
+class Exporter(object):
+    '''
+    Publishes stats snapshots in a memory mapped file, so an external process
+    can read them without stopping the event loop. The file starts with a
+    header holding a magic, a sequence number that is odd while a snapshot is
+    being written, and the length of the JSON encoded snapshot that follows.
+    '''
+    MAGIC = 'netstat1'
+    HEADER = struct.Struct('<8sQI')
+
+    def __init__(self, path, size=1 << 20):
+        self.path = path
+        self.size = size
+        self.sequence = 0
+        fd = os.open(path, os.O_RDWR | os.O_CREAT | os.O_TRUNC, 0644)
+        try:
+            os.ftruncate(fd, size)
+            self.map = mmap.mmap(fd, size)
+        finally:
+            os.close(fd)
+        self.HEADER.pack_into(self.map, 0, self.MAGIC, 0, 0)
+
+    def close(self):
+        self.map.close()
+
+    def write(self, snapshot):
+        data = json.dumps(snapshot)
+        offset = self.HEADER.size
+        if offset + len(data) > self.size:
+            raise ValueError('snapshot does not fit in %d bytes' % (self.size,))
+
+        self.sequence += 1
+        struct.pack_into('<Q', self.map, 8, self.sequence)
+        self.map[offset:offset + len(data)] = data
+        struct.pack_into('<I', self.map, 16, len(data))
+        self.sequence += 1
+        struct.pack_into('<Q', self.map, 8, self.sequence)
+
+
+def read_export(path, retries=100):
+    '''
+    Read the latest snapshot published by an Exporter.
+    '''
+    fd = os.open(path, os.O_RDONLY)
+    try:
+        data = mmap.mmap(fd, 0, prot=mmap.PROT_READ)
+    finally:
+        os.close(fd)
+
+    try:
+        for attempt in xrange(retries):
+            magic, sequence, length = Exporter.HEADER.unpack_from(data, 0)
+            if magic != Exporter.MAGIC:
+                raise ValueError('%s is not a stats export' % (path,))
+            if sequence & 1 or not sequence:
+                time.sleep(0.001)
+                continue
+            offset = Exporter.HEADER.size
+            snapshot = data[offset:offset + length]
+            if struct.unpack_from('<Q', data, 8)[0] == sequence:
+                return json.loads(snapshot)
+        return None
+    finally:
+        data.close()
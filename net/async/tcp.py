@@ -1,17 +1,51 @@
 import errno
+import fcntl
 import os
 import socket
+import struct
+import termios
 from net.async.const import *
+from net.async.coroutine import DRAIN, EXACTLY, LINE, SOME, Waiter
 from net.async.nonblocking import NonBlocking
+from net.async.resolver import Resolver, numeric
 from net.tools import get_errno
 
+try:
+    from net.family import _bare
+except ImportError:
+    _bare = None
+
 
 class Base(NonBlocking):
+    '''
+    Non blocking TCP connection. Received chunks are handed to the recv hooks
+    as recv(conn, chunk) and can be taken with read() while they run. They
+    only stay queued after that when retain is set.
+
+    Sends are queued and the connection is marked dirty, the Multiplexer
+    flushes dirty connections once per loop iteration. The retain, dirty
+    and corked flags, the coroutine waiter and the addresses left to try
+    when connecting live in Connection, so connections need no __dict__.
+    A corked connection holds on to what it queued until uncork.
+    '''
+    # Most bytes read in one turn of the event loop, reading stops early when
+    # a read does not fill the whole block
+    recv_budget = 65536
+    # Sends are coalesced per loop iteration, so Nagle only adds latency
+    nodelay = True
+    # Looks up host names for connect, the shared one when None
+    resolver = None
+    # Records what is received and sent, see net.async.capture
+    capture = None
+    capture_id = None
+
     def __init__(self, family=socket.AF_INET, type=socket.SOCK_STREAM, proto=0,
         async=None):
         super(Base, self).__init__(family, type, proto, async)
         self.connected  = False
         self.connecting = False
+        if self.nodelay:
+            self.set_option(socket.TCP_NODELAY, 1)
 
     def __repr__(self):
         return unicode(self)
@@ -19,34 +53,85 @@ class Base(NonBlocking):
     def __unicode__(self):
         return u'<tcp.Base>'
 
+    @property
+    def is_sending(self):
+        # Dirty connections are written by the flush, only wait for the
+        # socket to become writable once that could not send everything
+        return self.connecting or (not self.dirty and not self.corked
+            and super(Base, self).is_sending)
+
     def connect(self, address=None, callback=None):
-        error = self.socket.connect_ex(address or self.address)
-        if error != 0:
-            if error not in (errno.EINPROGRESS, errno.EWOULDBLOCK):
-                raise IOError(os.strerror(error))
+        address = address or self.address
+        host = isinstance(address, tuple) and address[0]
+        if host and numeric(host) is None:
+            # Looked up off the event loop, handle_resolve carries on
+            self.connecting = True
+            resolver = self.resolver or Resolver.shared()
+            resolver.resolve(self.async, host, address[1], self.handle_resolve)
+        else:
+            error = self.socket.connect_ex(address)
+            if error != 0:
+                if error not in (errno.EINPROGRESS, errno.EWOULDBLOCK):
+                    raise IOError(os.strerror(error))
 
-        # Set state to writable so our handler can check if we are connecting
-        self.connecting = True
-        self.set_state(WRITABLE)
+            # Set state to writable so our handler can check if we are
+            # connecting
+            self.connecting = True
+            self.set_state(WRITABLE)
 
         if callback:
             self.hook('connect', callback)
         return self
 
+    def connect_next(self, fresh=False):
+        '''
+        Connect to the next candidate address, starting over on a new socket
+        unless this one is fresh and of the right family. False when there
+        is nothing left to try.
+        '''
+        while self.candidates:
+            family, address = self.candidates.pop(0)
+            if not fresh or family != self.socket.family:
+                self.reopen(family)
+            fresh = False
+            error = self.socket.connect_ex(address)
+            if error in (0, errno.EINPROGRESS, errno.EWOULDBLOCK):
+                self.set_state(WRITABLE)
+                return True
+        return False
+
+    def reopen(self, family):
+        '''
+        Replace the socket with a new one of the given family.
+        '''
+        if self.states is not None:
+            self.async.unregister(self.fileno)
+            self.states = None
+        self.socket.close()
+        self.socket = self.create_socket(family, socket.SOCK_STREAM, 0)
+        self.socket.setblocking(False)
+        if self.busy_poll:
+            self.set_busy_poll(self.busy_poll, self.prefer_busy_poll)
+        if self.nodelay:
+            self.set_option(socket.TCP_NODELAY, 1)
+
     def handler(self, eventmask):
         if not self.socket:
             return
 
-        print 'handle', mask_str(eventmask)
         error = self.socket.getsockopt(socket.SOL_SOCKET, socket.SO_ERROR)
         try:
+            if self.connecting:
+                # Any event while connecting means the connect is done
+                self.handle_connect(error)
+                if self.connecting or not self.socket:
+                    return
+                error = 0
             if eventmask & READABLE:
                 self.handle_recv()
             if not self.socket:
                 return
             if eventmask & WRITABLE:
-                if self.connecting:
-                    self.handle_connect()
                 self.handle_send()
             if not self.socket:
                 return
@@ -55,93 +140,283 @@ class Base(NonBlocking):
                 self.async.queue(self.close)
                 return
 
-            states = ERROR
-            if self.is_reading:
-                states |= READABLE
-            if self.is_sending:
-                states |= WRITABLE
-            if states != self.states:
-                self.states = states
-                self.async.update(self.fileno, self.states)
+            self.update_state()
         except Exception, error:
             print self, 'UNHANDLED error in handler', error
             self.close()
             raise
 
-    def handle_connect(self):
-        error = self.socket.getsockopt(socket.SOL_SOCKET, socket.SO_ERROR)
+    def handle_connect(self, error=None):
+        if error is None:
+            error = self.socket.getsockopt(socket.SOL_SOCKET, socket.SO_ERROR)
         if error != 0:
+            if self.connect_next():
+                return
+            self.handle_error(socket.error(error, os.strerror(error)))
             self.close()
             return
         else:
-            self.fire('connect', self)
+            self.candidates = None
             self.connecting = False
+            self.connected = True
+            self.fire('connect', self)
+
+    def handle_resolve(self, addresses, error):
+        if not self.socket:
+            # Closed while we were looking it up
+            return
+        if error is None and not addresses:
+            error = socket.gaierror(socket.EAI_NONAME, 'no addresses found')
+        if error is not None:
+            self.handle_error(error)
+            self.close()
+            return
+        self.candidates = list(addresses)
+        if not self.connect_next(fresh=True):
+            self.handle_error(socket.error(errno.EHOSTUNREACH,
+                os.strerror(errno.EHOSTUNREACH)))
+            self.close()
 
     def handle_error(self, error):
         self.fire('error', self, error)
 
     def handle_recv(self):
-        try:
+        budget = self.recv_budget
+        while budget > 0:
+            blocksize = self.blocksize
             size = self.recv()
-        except Exception, error:
-            raise
-            self.close()
-            return
+            if size < blocksize or not self.socket or not self.is_reading:
+                break
+            budget -= size
 
     def recv(self):
         chunk = self.recv_chunk()
         if chunk is None:
             return 0
-        self.buffer['recv'].append(chunk)
-        self.fire('recv', self, chunk)
+        if self.capture is not None:
+            self.capture.record(self, CAPTURE_RECV, chunk)
+        self.received(chunk)
         return len(chunk)
 
     def recv_chunk(self):
+        blocksize = self.blocksize
+        if self.fionread:
+            waiting = struct.unpack('i', fcntl.ioctl(self.fileno,
+                termios.FIONREAD, '\0\0\0\0'))[0]
+            if waiting:
+                blocksize = min(waiting, self.max_blocksize)
+        # Never read far beyond the high watermark of the receive queue
+        room = self.watermarks['recv'][1] - self.recv_queued
+        blocksize = min(blocksize, max(room, self.min_blocksize))
+
+        buffers = self.async.buffers
+        buf = buffers.acquire(blocksize)
         try:
-            chunk = self.socket.recv(self.blocksize)
+            self.recv_calls += 1
+            size = self.socket.recv_into(buf, blocksize)
+            self.recv_bytes += size
+            chunk = memoryview(buf)[:size].tobytes()
         except socket.error, e:
             error = get_errno(e)
             if error in (errno.EWOULDBLOCK, errno.EAGAIN):
                 return None
             else:
                 raise
+        finally:
+            buffers.release(buf)
 
         if not chunk:
             self.close()
             return None
         else:
+            # Only learn from reads that were not sized for us
+            if blocksize == self.blocksize:
+                self.adapt_blocksize(size)
             return chunk
 
+    def set_option(self, option, value):
+        try:
+            self.socket.setsockopt(socket.IPPROTO_TCP, option, value)
+        except socket.error, e:
+            # Not a TCP socket, for example AF_UNIX
+            if get_errno(e) not in (errno.EOPNOTSUPP, errno.ENOPROTOOPT):
+                raise
+
     def send(self, data):
-        self.buffer['send'].append(data)
+        self.queue_data('send', data)
+        if not self.dirty and not self.corked and self.states is not None:
+            self.dirty = True
+            self.async.dirty.append(self)
+
+    def close(self):
+        if self.capture_id is not None and self.socket:
+            self.capture.record(self, CAPTURE_CLOSE)
+        return super(Base, self).close()
+
+    def flush(self):
+        '''
+        Write out what was queued with a single gathered write, called by the
+        Multiplexer once per loop iteration. What does not fit in the socket
+        buffer waits for the socket to become writable.
+        '''
+        self.dirty = False
+        if not self.socket or self.connecting or self.corked \
+                or not self.send_buffer:
+            return
+        try:
+            self.handle_send()
+        except EnvironmentError:
+            # Gone, the reading side will tell the same story
+            self.close()
+            return
+        self.update_state()
+
+    def cork(self):
+        '''
+        Hold back what is sent until uncork, so a response that is written
+        over several loop iterations goes out in one write of full sized
+        segments.
+        '''
+        self.corked = True
+        self.set_option(socket.TCP_CORK, 1)
+
+    def uncork(self):
+        self.corked = False
+        self.flush()
+        if self.socket:
+            self.set_option(socket.TCP_CORK, 0)
 
     def send_line(self, line):
-        self.buffer['send'].append(''.join([line, '\r\n']))
+        self.send(''.join([line, '\r\n']))
+
+    def create_waiter(self):
+        # Waiters complete once enough has arrived
+        self.retain = True
+        self.waiter = Waiter(self)
+        return self.waiter
+
+    def read_line(self):
+        '''
+        Coroutine waiter for the next line without its line ending, or None
+        once the connection is closed::
+
+            line = yield conn.read_line()
+        '''
+        waiter = self.waiter or self.create_waiter()
+        waiter.kind = LINE
+        return waiter
+
+    def read_exactly(self, size):
+        '''
+        Coroutine waiter for exactly size bytes, or None once the connection
+        is closed.
+        '''
+        waiter = self.waiter or self.create_waiter()
+        waiter.kind = EXACTLY
+        waiter.size = size
+        return waiter
+
+    def read_some(self):
+        '''
+        Coroutine waiter for whatever is received next, or None once the
+        connection is closed.
+        '''
+        waiter = self.waiter or self.create_waiter()
+        waiter.kind = SOME
+        return waiter
+
+    def drain(self):
+        '''
+        Coroutine waiter for the send queue to drop to its low watermark,
+        nothing to wait for if it is there already::
+
+            yield conn.drain()
+        '''
+        if self.send_queued <= self.watermarks['send'][0] and self.socket:
+            return None
+        waiter = self.waiter or self.create_waiter()
+        waiter.kind = DRAIN
+        return waiter
 
     def handle_send(self):
-        if not self.buffer['send']:
+        buffer = self.send_buffer
+        if not buffer:
             return
 
         try:
-            chunk = self.buffer['send'].pop(0)
-            # It can happen that the chunk can only be sent partially, if this
-            # happens re-buffer the remaining part
-            size = self.socket.send(chunk)
-            if size < len(chunk):
-                self.buffer['send'].insert(0, chunk[size:])
-        except socket.error, e:
+            # Everything that is queued in one gathered write
+            if len(buffer) == 1:
+                size = self.socket.send(buffer[0])
+            elif _bare is not None:
+                size = _bare.sendmsg(self.fileno, buffer)
+            else:
+                size = self.socket.send(self.gather(buffer))
+        except EnvironmentError, e:
             error = get_errno(e)
             if error in (errno.EWOULDBLOCK, errno.EAGAIN):
                 # Back off a bit
-                self.buffer['send'].insert(0, chunk)
                 return
+            raise
+
+        self.send_calls += 1
+        self.send_bytes += size
+        # Drop what was sent, a chunk that was sent partially keeps the rest
+        sent = 0
+        for index, chunk in enumerate(buffer):
+            if sent + len(chunk) > size:
+                break
+            sent += len(chunk)
+        else:
+            index = len(buffer)
+        if self.capture is not None:
+            # What went out on the wire, not what was queued
+            written = buffer[:index]
+            if sent < size:
+                written.append(buffer[index][:size - sent])
+            self.capture.record(self, CAPTURE_SEND, ''.join(written))
+        if sent < size:
+            buffer[index] = buffer[index][size - sent:]
+        del buffer[:index]
+        self.dequeue_data('send', size)
+        if self.waiter is not None:
+            self.waiter.handle_send()
+
+    def gather(self, buffer):
+        '''
+        The queued buffers joined for a single send() when _bare.sendmsg is
+        not available, copying at most send_limit bytes.
+        '''
+        limit = self.send_limit or self.max_blocksize
+        total = 0
+        for count, chunk in enumerate(buffer):
+            total += len(chunk)
+            if total >= limit:
+                break
+        if count == 0:
+            return buffer[0]
+        return ''.join(buffer[:count + 1])
 
 class Client(Base):
     def __init__(self, address, async=None):
-        super(Client, self).__init__(async=async)
-        self.address = address
         if isinstance(address, int):
-            self.from_fd(address)
+            # A connected descriptor, which is ours from now on. fromfd
+            # works on a duplicate, so the original is closed
+            fd = address
+            address = socket.fromfd(fd, socket.AF_INET, socket.SOCK_STREAM)
+            os.close(fd)
+        if isinstance(address, (socket.socket, socket._realsocket)):
+            # Already connected, for example by Server.handle_accept
+            super(Client, self).__init__(address, async=async)
+            try:
+                self.address = address.getpeername()
+            except socket.error:
+                # Reset before we got to it, the first read will tell
+                self.address = ('', 0)
+            self.connected = True
+            self.update_state()
+        else:
+            super(Client, self).__init__(async=async)
+            self.address = address
 
     def __unicode__(self):
         return u'<tcp.Client address=%s:%d>' % (self.address[0],
@@ -149,21 +424,76 @@ class Client(Base):
 
 
 class Server(Base):
+    priority = PRIORITY_LISTENER
+    # Most connections accepted in one turn of the event loop. Kept
+    # small, an accept costs more than serving a request and the rest just
+    # waits in the backlog
+    accept_budget = 4
+    # Seconds to stop accepting after running out of descriptors or memory,
+    # so connections get a chance to close
+    accept_backoff = 0.1
+
     def __init__(self, address, backlog=128, async=None):
-        super(Server, self).__init__(async=async)
-        self.socket.bind(address)
-        try:
-            self.socket.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
-        except socket.error:
-            pass
-        self.socket.listen(backlog)
+        if isinstance(address, (socket.socket, socket._realsocket)):
+            # Already listening, for example handed over by another process
+            super(Server, self).__init__(address, async=async)
+        else:
+            super(Server, self).__init__(async=async)
+            self.socket.bind(address)
+            try:
+                self.socket.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR,
+                    1)
+            except socket.error:
+                pass
+            self.socket.listen(backlog)
+        self.address = self.socket.getsockname()
         self.connected = True
-        self.hook('recv', self.handle_accept)
+        self.update_state()
+
+    @property
+    def is_reading(self):
+        return not self.is_paused('recv')
+
+    def handle_recv(self):
+        for x in xrange(self.accept_budget):
+            if self.handle_accept() is None or not self.is_reading:
+                break
+
+    def handle_accept(self):
+        '''
+        Accept one connection. None when there is nothing to accept now,
+        False when one was gone before we got to it.
+        '''
+        try:
+            sock, address = self.socket.accept()
+        except socket.error, e:
+            error = get_errno(e)
+            if error in (errno.EWOULDBLOCK, errno.EAGAIN):
+                return None
+            if error in (errno.ECONNABORTED, errno.EPROTO):
+                # Try the next one
+                return False
+            # The listener stays, only this connection is lost
+            self.handle_error(e)
+            if error in (errno.EMFILE, errno.ENFILE, errno.ENOBUFS,
+                    errno.ENOMEM) and self.socket:
+                # Still readable, we would only spin on the same error
+                self.pause('recv')
+                self.update_state()
+                self.async.later(self.accept_backoff, self.resume_accept)
+            return None
+
+        client = Client(sock, async=self.async)
+        if self.capture is not None:
+            client.capture = self.capture
+            self.capture.record(client, CAPTURE_OPEN)
+        self.fire('accept', client)
+        return client
 
-    def handle_accept(self, *args):
-        client, address = self.socket.accept()
-        print 'new client', client, 'from', address
-        return Client(client.fileno(), async=self.async)
+    def resume_accept(self):
+        if self.socket:
+            self.resume('recv')
+            self.update_state()
 
     def __unicode__(self):
         return u'<tcp.Server address=%s:%d>' % (self.address[0],
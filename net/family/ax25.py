@@ -26,13 +26,20 @@ class socket(bare.socket):
     def __init__(self, family=bare.AF_AX25, type=bare.SOCK_SEQPACKET, proto=0, fd=0):
         super(socket, self).__init__(family, type, proto, fd)
 
-    def accept(self):
-        addr, fd = _ax25.accept(self.fileno())
+    def accept(self, flags=0):
+        addr, fd = _ax25.accept(self.fileno(), flags)
         return ntoa(addr), socket.fromfd(fd, self.family, self.type)
         
     def bind(self, call):
         return _ax25.bind(self.fileno(), call)
 
+    def recvfrom(self, size, flags=0):
+        data, addr = _ax25.recvfrom(self.fileno(), size, flags)
+        return data, ntoa(addr)
+
+    def sendto(self, string, call, flags=0):
+        return _ax25.sendto(self.fileno(), string, len(string), flags, call)
+
     @staticmethod
     def fromfd(fd, family, type):
         return socket(family=family, type=type, fd=fd)
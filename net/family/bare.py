@@ -1,3 +1,4 @@
+import fcntl
 import os
 
 # Import c extension
@@ -30,15 +31,38 @@ class socket(object):
     def fromfd(fd, family, type):
         return socket(family=family, type=type, fd=fd)
 
+    def setblocking(self, flag):
+        flags = fcntl.fcntl(self.fileno(), fcntl.F_GETFL)
+        if flag:
+            flags &= ~os.O_NONBLOCK
+        else:
+            flags |= os.O_NONBLOCK
+        fcntl.fcntl(self.fileno(), fcntl.F_SETFL, flags)
+
     def listen(self, backlog=128):
         return _bare.listen(self.fileno(), backlog)
 
     def recv(self, size=0, flags=0):
         return _bare.recv(self.fileno(), size, flags)
 
+    def recv_into(self, buffer, size=0, flags=0):
+        return _bare.recv_into(self.fileno(), buffer, size, flags)
+
     def send(self, string, flags=0):
         return _bare.send(self.fileno(), string, len(string), flags)
 
+    def sendmsg(self, buffers, flags=0):
+        return _bare.sendmsg(self.fileno(), buffers, flags)
+
+    def send_fds(self, data, fds, flags=0):
+        return _bare.send_fds(self.fileno(), data, fds, flags)
+
+    def recv_fds(self, size, maxfds, flags=0):
+        return _bare.recv_fds(self.fileno(), size, maxfds, flags)
+
+    def busy_poll(self, usecs, prefer=False):
+        return _bare.busy_poll(self.fileno(), usecs, int(prefer))
+
     def write(self, string, flags=0):
         return self.send(string, flags=flags)
 
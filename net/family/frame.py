@@ -0,0 +1,134 @@
+'''
+AX.25 frames, decoded to (dest, src, digis, control, pid, info) tuples. Digi
+peaters that have repeated a frame carry a trailing '*', as in monitor output.
+'''
+
+# Native decoder, with a pure Python fallback
+try:
+    from net.family import _frame
+except ImportError:
+    _frame = None
+
+MAX_DIGIS = 8
+
+
+def has_pid(control):
+    # I and UI frames carry a protocol id
+    return control & 0x01 == 0 or control & 0xef == 0x03
+
+
+class PyDecoder(object):
+    '''
+    Decoder with the same interface as the _frame extension, used when it is
+    not available. Records come as a list of tuples.
+    '''
+
+    def __init__(self):
+        self.hits = 0
+        self.misses = 0
+        self.errors = 0
+        self.clear()
+
+    @property
+    def callsigns(self):
+        return len(self.names)
+
+    def clear(self):
+        self.cache = {}
+        self.names = []
+
+    def callsign(self, id):
+        return self.names[id]
+
+    def address(self, field, repeated=False):
+        key = field[:6] + chr(ord(field[6]) & 0x1e)
+        call = self.cache.get(key)
+        if call is None:
+            self.misses += 1
+            call = ''.join([chr(ord(c) >> 1) for c in field[:6]]).rstrip(' ')
+            ssid = (ord(field[6]) >> 1) & 0x0f
+            if ssid:
+                call = '%s-%d' % (call, ssid)
+            call = intern(call)
+            self.cache[key] = call
+            self.names.append(call)
+        else:
+            self.hits += 1
+        if repeated and ord(field[6]) & 0x80:
+            return call + '*'
+        return call
+
+    def decode(self, frames):
+        records = []
+        for frame in frames:
+            record = self.decode_frame(frame)
+            if record is None:
+                self.errors += 1
+            else:
+                records.append(record)
+        return records
+
+    def decode_frame(self, frame):
+        offset = 0
+        fields = []
+        while True:
+            if offset + 7 >= len(frame) or len(fields) == MAX_DIGIS + 2:
+                return None
+            field = frame[offset:offset + 7]
+            fields.append(field)
+            offset += 7
+            if ord(field[6]) & 0x01:
+                break
+        if len(fields) < 2:
+            return None
+
+        control = ord(frame[offset])
+        offset += 1
+        pid = None
+        if has_pid(control):
+            if offset == len(frame):
+                return None
+            pid = ord(frame[offset])
+            offset += 1
+        # Only call signs of frames that are accepted go into the cache
+        calls = [self.address(field, index > 1)
+            for index, field in enumerate(fields)]
+        return (calls[0], calls[1], tuple(calls[2:]), control, pid,
+            frame[offset:])
+
+
+def py_address(call, bits=0):
+    repeated = call.endswith('*')
+    if repeated:
+        call = call[:-1]
+    call, _, ssid = call.upper().partition('-')
+    if not call or len(call) > 6 or not call.isalnum() \
+        or (_ and not ssid.isdigit()) or int(ssid or 0) > 15:
+        raise ValueError('malformed call sign %s' % (call,))
+    if repeated:
+        bits |= 0x80
+    return ''.join([chr(ord(c) << 1) for c in call.ljust(6)]) \
+        + chr(0x60 | int(ssid or 0) << 1 | bits)
+
+def py_encode(dest, src, digis=(), control=0x03, pid=0xf0, info='',
+    command=True):
+    if len(digis or ()) > MAX_DIGIS:
+        raise ValueError('too many digipeaters')
+    # Version 2 commands set C in the destination, responses in the source
+    fields = [py_address(dest, command and 0x80 or 0),
+        py_address(src, not command and 0x80 or 0)]
+    fields.extend([py_address(digi) for digi in digis or ()])
+    fields[-1] = fields[-1][:6] + chr(ord(fields[-1][6]) | 0x01)
+    fields.append(chr(control))
+    if has_pid(control):
+        fields.append(chr(pid))
+    fields.append(info)
+    return ''.join(fields)
+
+
+if _frame:
+    Decoder = _frame.Decoder
+    encode = _frame.encode
+else:
+    Decoder = PyDecoder
+    encode = py_encode
@@ -0,0 +1,124 @@
+'''
+KISS framing between a host and a TNC, see
+http://www.ax25.net/kiss.aspx for the protocol.
+'''
+
+# Native codec, with a pure Python fallback
+try:
+    from net.family import _kiss
+except ImportError:
+    _kiss = None
+
+FEND  = 0xc0
+FESC  = 0xdb
+TFEND = 0xdc
+TFESC = 0xdd
+
+# Commands, in the low nibble of the type byte
+DATA        = 0x00
+TXDELAY     = 0x01
+PERSISTENCE = 0x02
+SLOTTIME    = 0x03
+TXTAIL      = 0x04
+FULLDUPLEX  = 0x05
+SETHARDWARE = 0x06
+RETURN      = 0x0f
+
+_FEND = chr(FEND)
+_FESC = chr(FESC)
+_ESCAPED_FEND = chr(FESC) + chr(TFEND)
+_ESCAPED_FESC = chr(FESC) + chr(TFESC)
+
+
+def py_encode(frame, port=0, command=DATA):
+    frame = frame.replace(_FESC, _ESCAPED_FESC).replace(_FEND, _ESCAPED_FEND)
+    return ''.join([_FEND, chr(((port & 0x0f) << 4) | (command & 0x0f)),
+        frame, _FEND])
+
+
+def py_encode_batch(frames, port=0, command=DATA):
+    if not frames:
+        return ''
+    # Back to back frames share the FEND in between
+    return ''.join([py_encode(frame, port, command)[:-1]
+        for frame in frames] + [_FEND])
+
+
+class PyDecoder(object):
+    '''
+    Incremental decoder with the same interface as the _kiss extension, used
+    when it is not available.
+    '''
+
+    def __init__(self, maxsize=4096):
+        if maxsize <= 0:
+            raise ValueError('maxsize must be positive')
+        self.maxsize = maxsize
+        self.frames = 0
+        self.errors = 0
+        self.reset()
+
+    @property
+    def pending(self):
+        return len(self.partial)
+
+    def reset(self):
+        self.partial = ''
+        self.synced = False
+
+    def feed(self, data):
+        if not self.synced:
+            start = data.find(_FEND)
+            if start == -1:
+                return []
+            self.synced = True
+            data = data[start + 1:]
+
+        chunks = (self.partial + data).split(_FEND)
+        self.partial = chunks.pop()
+        if len(self.partial) > self.maxsize * 2 + 1:
+            # Whatever it becomes, it will be too big
+            self.partial = ''
+            self.synced = False
+            self.errors += 1
+
+        frames = []
+        for chunk in chunks:
+            if not chunk:
+                continue
+            if chunk.endswith(_FESC) and not chunk.endswith(_ESCAPED_FESC):
+                self.errors += 1
+                continue
+            if _FESC in chunk:
+                chunk = self.unescape(chunk)
+            if len(chunk) > self.maxsize + 1:
+                self.errors += 1
+                continue
+            self.frames += 1
+            type = ord(chunk[0])
+            frames.append((type >> 4, type & 0x0f, chunk[1:]))
+        return frames
+
+    def unescape(self, chunk):
+        parts = chunk.split(_FESC)
+        result = [parts[0]]
+        for part in parts[1:]:
+            if part[:1] == chr(TFEND):
+                result.append(_FEND)
+            elif part[:1] == chr(TFESC):
+                result.append(_FESC)
+            else:
+                self.errors += 1
+                result.append(part[:1])
+            result.append(part[1:])
+        return ''.join(result)
+
+
+if _kiss:
+    encode = _kiss.encode
+    encode_batch = _kiss.encode_batch
+    Decoder = _kiss.Decoder
+else:
+    encode = py_encode
+    encode_batch = py_encode_batch
+    Decoder = PyDecoder
@@ -1,11 +1,12 @@
-from distutils.core import setup, Extension
-from distutils.ccompiler import new_compiler
-import select
-import sys
+# setuptools patches distutils, import it before taking Extension from there
 try:
     import setuptools
 except ImportError:
     pass
+from distutils.core import setup, Extension
+from distutils.ccompiler import new_compiler
+import select
+import sys
 
 extensions = []
 
@@ -15,9 +16,11 @@ def find_epoll():
         print 'using select.epoll'
     else:
         print 'using extension'
-        extensions.append(Extension('net/async/_epoll',
-            sources = ['src/async/_epoll.c'],
-        ))        
+    # Always built, so the backends can be benchmarked against each other
+    extensions.append(Extension('net.async._epoll',
+        sources = ['src/async/_epoll.c'],
+        depends = ['src/async/histogram.h'],
+    ))
 
 def find_kqueue():
     # kqueue support for Python before 2.6
@@ -26,10 +29,31 @@ def find_kqueue():
         print 'using select.kqueue'
     else:
         print 'using extension'
-        extensions.append(Extension('net/async/_kqueue',
+        extensions.append(Extension('net.async._kqueue',
             sources = ['src/async/_kqueue.c'],
         ))
 
+# Event loop instrumentation, on every platform
+extensions.append(Extension('net.async._stats',
+    sources = ['src/async/_stats.c'],
+    depends = ['src/async/histogram.h'],
+))
+
+# Compact connection objects, on every platform
+extensions.append(Extension('net.async._connection',
+    sources = ['src/async/_connection.c'],
+))
+
+# KISS framing for TNCs, on every platform
+extensions.append(Extension('net.family._kiss',
+    sources = ['src/family/_kiss.c'],
+))
+
+# AX.25 frame decoding, does not need libax25
+extensions.append(Extension('net.family._frame',
+    sources = ['src/family/_frame.c'],
+))
+
 print 'looking for platform ..',
 if sys.platform.startswith('linux'):
     print 'Linux'
@@ -43,13 +67,18 @@ if sys.platform.startswith('linux'):
     lib_ax25 = compiler.find_library_file(lib_dirs, 'ax25')
     if lib_ax25:
         print lib_ax25
-        extensions.append(Extension('net/family/_ax25',
+        extensions.append(Extension('net.family._ax25',
             sources = ['src/family/_ax25.c'],
             libraries = ['ax25', 'ax25io'],
         ))
     else:
         print 'no'
 
+    # Bare sockets, does not need libax25
+    extensions.append(Extension('net.family._bare',
+        sources = ['src/family/_bare.c'],
+    ))
+
     # Linux uses epoll interface
     find_epoll()
 
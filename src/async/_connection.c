@@ -0,0 +1,1000 @@
+#include <Python.h>
+#include <structmember.h>
+
+#include <errno.h>
+#include <string.h>
+
+/* The module doc string */
+PyDoc_STRVAR(_connection__doc__, "Compact connection state for the event loop");
+
+/* The function doc string */
+PyDoc_STRVAR(Connection__doc__,     "Connection()\n\nSocket, queues and hooks of a single connection.");
+PyDoc_STRVAR(hook__doc__,           "hook(group, hook, *args, **kwargs)\n\nCall hook when group fires.");
+PyDoc_STRVAR(unhook__doc__,         "unhook(group, target)\n\nRemove target from the hooks of group.");
+PyDoc_STRVAR(unhook_group__doc__,   "unhook_group(group)\n\nFlush all hooks for a given group.");
+PyDoc_STRVAR(fire__doc__,           "fire(group, *args, **kwargs)\n\nCall all hooks of group.");
+PyDoc_STRVAR(fire_and_forget__doc__, "fire_and_forget(group, *args, **kwargs)\n\nCall and flush all hooks of group.");
+PyDoc_STRVAR(fire_hook__doc__,      "fire_hook(hook, *args, **kwargs)\n\nCall a single hook.");
+PyDoc_STRVAR(is_paused__doc__,      "is_paused(queue) -> bool\n\nCheck if the recv or send queue is paused.");
+PyDoc_STRVAR(pause__doc__,          "pause(queue)\n\nPause the recv or send queue until resume(), whatever it holds.");
+PyDoc_STRVAR(resume__doc__,         "resume(queue)\n\nResume a paused queue.");
+PyDoc_STRVAR(queue_data__doc__,     "queue_data(queue, data[, watermark])\n\nAppend data to a queue, pause it if it is filling up unless watermark is false.");
+PyDoc_STRVAR(dequeue_data__doc__,   "dequeue_data(queue, size) -> resumed\n\nAccount for data taken from a queue, resume it once drained.");
+PyDoc_STRVAR(read__doc__,           "read([size]) -> data\n\nTake up to size bytes (or everything) from the receive queue. Received data\nis queued while the recv hooks run, and only stays queued until it is read\nwhen the connection retains its receive queue.");
+PyDoc_STRVAR(take_line__doc__,      "take_line() -> line\n\nTake the first line from the receive queue without its line ending, None if no full line is queued.");
+
+/* Queues */
+#define RECV 0
+#define SEND 1
+
+/* Flags */
+#define CONNECTED   0x01
+#define CONNECTING  0x02
+#define REGISTERED  0x04
+#define RECV_PAUSED 0x08
+#define SEND_PAUSED 0x10
+// Received data stays queued until it is read
+#define RETAIN      0x20
+// Queued sends wait for the Multiplexer to flush them
+#define DIRTY       0x40
+// Queued sends are held back until uncorked
+#define CORKED      0x80
+
+/* Hook groups with an inline slot, anything else goes in a dict */
+#define HOOK_SLOTS  8
+#define HOOK_RECV   0
+#define HOOK_SEND   1
+#define HOOK_PAUSE  4
+#define HOOK_RESUME 5
+static const char *hook_names[HOOK_SLOTS] = {
+    "recv", "send", "connect", "close", "pause", "resume", "accept", "error",
+};
+static PyObject *hook_groups[HOOK_SLOTS];
+static PyObject *queue_names[2];
+static PyObject *str_watermarks, *str_send_limit, *str_update_state;
+
+typedef struct {
+    PyObject_HEAD
+    int fd;
+    unsigned int states;
+    unsigned int flags;
+    int blocksize;
+    Py_ssize_t queued[2];
+    Py_ssize_t recv_calls;
+    Py_ssize_t recv_bytes;
+    Py_ssize_t send_calls;
+    Py_ssize_t send_bytes;
+    PyObject *socket;
+    PyObject *async;
+    PyObject *address;
+    PyObject *buffers[2];
+    PyObject *hooks[HOOK_SLOTS];
+    PyObject *extra_hooks;
+    // Coroutine waiter, and addresses left to try when connecting
+    PyObject *waiter;
+    PyObject *candidates;
+} ConnectionObject;
+
+/* Helpers */
+
+static int
+hook_slot(PyObject *group) {
+    int i;
+
+    if (!PyString_CheckExact(group)) {
+        return -1;
+    }
+    // Interned strings first, they are what Python code passes in
+    for (i = 0; i < HOOK_SLOTS; ++i) {
+        if (group == hook_groups[i]) {
+            return i;
+        }
+    }
+    for (i = 0; i < HOOK_SLOTS; ++i) {
+        if (strcmp(PyString_AS_STRING(group), hook_names[i]) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/* Borrowed list of hooks for group, or NULL */
+static PyObject *
+hooks_get(ConnectionObject *self, PyObject *group) {
+    int slot = hook_slot(group);
+
+    if (slot >= 0) {
+        return self->hooks[slot];
+    }
+    if (self->extra_hooks == NULL) {
+        return NULL;
+    }
+    return PyDict_GetItem(self->extra_hooks, group);
+}
+
+/* Borrowed list of hooks for group, created when missing */
+static PyObject *
+hooks_create(ConnectionObject *self, PyObject *group) {
+    PyObject *list;
+    int slot = hook_slot(group);
+
+    if (slot >= 0) {
+        if (self->hooks[slot] == NULL) {
+            self->hooks[slot] = PyList_New(0);
+        }
+        return self->hooks[slot];
+    }
+
+    if (self->extra_hooks == NULL
+        && (self->extra_hooks = PyDict_New()) == NULL) {
+        return NULL;
+    }
+    if ((list = PyDict_GetItem(self->extra_hooks, group)) != NULL) {
+        return list;
+    }
+    if ((list = PyList_New(0)) == NULL) {
+        return NULL;
+    }
+    if (PyDict_SetItem(self->extra_hooks, group, list) == -1) {
+        Py_DECREF(list);
+        return NULL;
+    }
+    Py_DECREF(list);
+    return list;
+}
+
+static int
+hooks_clear(ConnectionObject *self, PyObject *group) {
+    int slot = hook_slot(group);
+
+    if (slot >= 0) {
+        Py_CLEAR(self->hooks[slot]);
+        return 0;
+    }
+    if (self->extra_hooks != NULL
+        && PyDict_GetItem(self->extra_hooks, group) != NULL) {
+        return PyDict_DelItem(self->extra_hooks, group);
+    }
+    return 0;
+}
+
+static int
+queue_index(PyObject *queue) {
+    if (queue == queue_names[RECV]) {
+        return RECV;
+    }
+    if (queue == queue_names[SEND]) {
+        return SEND;
+    }
+    if (PyString_Check(queue)) {
+        if (strcmp(PyString_AS_STRING(queue), "recv") == 0) {
+            return RECV;
+        }
+        if (strcmp(PyString_AS_STRING(queue), "send") == 0) {
+            return SEND;
+        }
+    }
+    PyErr_Format(PyExc_KeyError, "unknown queue %s",
+        PyString_Check(queue) ? PyString_AS_STRING(queue) : "?");
+    return -1;
+}
+
+/* Borrowed buffer list of a queue, created when missing */
+static PyObject *
+buffer_get(ConnectionObject *self, int queue) {
+    if (self->buffers[queue] == NULL) {
+        self->buffers[queue] = PyList_New(0);
+    }
+    return self->buffers[queue];
+}
+
+/* Look up the (low, high) watermarks of a queue */
+static int
+watermarks(ConnectionObject *self, int queue, Py_ssize_t *low, Py_ssize_t *high) {
+    PyObject *marks, *pair;
+    int result = -1;
+
+    if ((marks = PyObject_GetAttr((PyObject *) self, str_watermarks)) == NULL) {
+        return -1;
+    }
+    if ((pair = PyObject_GetItem(marks, queue_names[queue])) != NULL) {
+        if (PyArg_ParseTuple(pair, "nn", low, high)) {
+            result = 0;
+        }
+        Py_DECREF(pair);
+    }
+    Py_DECREF(marks);
+    return result;
+}
+
+static int
+fire_list(PyObject *hooks, PyObject *args, PyObject *kwargs) {
+    PyObject *item, *hook, *call_args, *call_kwargs, *result;
+    Py_ssize_t i;
+
+    if (hooks == NULL) {
+        return 0;
+    }
+
+    // Hooks may (un)hook while we are firing, so index the live list
+    Py_INCREF(hooks);
+    for (i = 0; i < PyList_GET_SIZE(hooks); ++i) {
+        item = PyList_GET_ITEM(hooks, i);
+        Py_INCREF(item);
+        hook = PyTuple_GET_ITEM(item, 0);
+        call_args = PyTuple_GET_SIZE(args) ? args : PyTuple_GET_ITEM(item, 1);
+        call_kwargs = (kwargs && PyDict_Size(kwargs)) ? kwargs
+            : PyTuple_GET_ITEM(item, 2);
+        if (call_kwargs == Py_None) {
+            call_kwargs = NULL;
+        }
+        result = PyObject_Call(hook, call_args, call_kwargs);
+        Py_DECREF(item);
+        if (result == NULL) {
+            Py_DECREF(hooks);
+            return -1;
+        }
+        Py_DECREF(result);
+    }
+    Py_DECREF(hooks);
+    return 0;
+}
+
+static int
+fire_group(ConnectionObject *self, int slot, PyObject *queue) {
+    PyObject *args;
+    int result;
+
+    if (self->hooks[slot] == NULL) {
+        return 0;
+    }
+    if ((args = PyTuple_Pack(2, (PyObject *) self, queue)) == NULL) {
+        return -1;
+    }
+    result = fire_list(self->hooks[slot], args, NULL);
+    Py_DECREF(args);
+    return result;
+}
+
+/* Type methods */
+
+static PyObject *
+py_connection_new(PyTypeObject *type, PyObject *args, PyObject *kwargs) {
+    ConnectionObject *self;
+
+    if ((self = (ConnectionObject *) type->tp_alloc(type, 0)) == NULL) {
+        return NULL;
+    }
+    self->fd = -1;
+    self->blocksize = 4096;
+    return (PyObject *) self;
+}
+
+static int
+py_connection_init(ConnectionObject *self, PyObject *args, PyObject *kwargs) {
+    return 0;
+}
+
+static int
+py_connection_traverse(ConnectionObject *self, visitproc visit, void *arg) {
+    int i;
+
+    Py_VISIT(self->socket);
+    Py_VISIT(self->async);
+    Py_VISIT(self->address);
+    Py_VISIT(self->buffers[RECV]);
+    Py_VISIT(self->buffers[SEND]);
+    for (i = 0; i < HOOK_SLOTS; ++i) {
+        Py_VISIT(self->hooks[i]);
+    }
+    Py_VISIT(self->extra_hooks);
+    Py_VISIT(self->waiter);
+    Py_VISIT(self->candidates);
+    return 0;
+}
+
+static int
+py_connection_clear(ConnectionObject *self) {
+    int i;
+
+    Py_CLEAR(self->socket);
+    Py_CLEAR(self->async);
+    Py_CLEAR(self->address);
+    Py_CLEAR(self->buffers[RECV]);
+    Py_CLEAR(self->buffers[SEND]);
+    for (i = 0; i < HOOK_SLOTS; ++i) {
+        Py_CLEAR(self->hooks[i]);
+    }
+    Py_CLEAR(self->extra_hooks);
+    Py_CLEAR(self->waiter);
+    Py_CLEAR(self->candidates);
+    return 0;
+}
+
+static void
+py_connection_dealloc(ConnectionObject *self) {
+    PyObject_GC_UnTrack(self);
+    py_connection_clear(self);
+    Py_TYPE(self)->tp_free((PyObject *) self);
+}
+
+/* Hookable interface */
+
+static PyObject *
+py_connection_hook(ConnectionObject *self, PyObject *args, PyObject *kwargs) {
+    PyObject *group, *hook, *rest, *item, *list;
+
+    if (PyTuple_GET_SIZE(args) < 2) {
+        PyErr_SetString(PyExc_TypeError, "hook() takes a group and a hook");
+        return NULL;
+    }
+    group = PyTuple_GET_ITEM(args, 0);
+    hook = PyTuple_GET_ITEM(args, 1);
+
+    if ((list = hooks_create(self, group)) == NULL) {
+        return NULL;
+    }
+    if ((rest = PyTuple_GetSlice(args, 2, PyTuple_GET_SIZE(args))) == NULL) {
+        return NULL;
+    }
+    // Don't keep an empty kwargs dict around for every hook
+    item = PyTuple_Pack(3, hook, rest,
+        (kwargs && PyDict_Size(kwargs)) ? kwargs : Py_None);
+    Py_DECREF(rest);
+    if (item == NULL) {
+        return NULL;
+    }
+    if (PyList_Append(list, item) == -1) {
+        Py_DECREF(item);
+        return NULL;
+    }
+    Py_DECREF(item);
+    Py_RETURN_NONE;
+}
+
+static PyObject *
+py_connection_unhook(ConnectionObject *self, PyObject *args) {
+    PyObject *group, *target, *list, *item;
+    Py_ssize_t i;
+    int equal;
+
+    if (!PyArg_ParseTuple(args, "OO", &group, &target)) {
+        return NULL;
+    }
+    if ((list = hooks_get(self, group)) == NULL) {
+        Py_RETURN_NONE;
+    }
+
+    for (i = PyList_GET_SIZE(list) - 1; i >= 0; --i) {
+        item = PyList_GET_ITEM(list, i);
+        equal = PyObject_RichCompareBool(PyTuple_GET_ITEM(item, 0), target, Py_EQ);
+        if (equal == -1) {
+            return NULL;
+        }
+        if (equal && PySequence_DelItem(list, i) == -1) {
+            return NULL;
+        }
+    }
+    Py_RETURN_NONE;
+}
+
+static PyObject *
+py_connection_unhook_group(ConnectionObject *self, PyObject *group) {
+    if (hooks_clear(self, group) == -1) {
+        return NULL;
+    }
+    Py_RETURN_NONE;
+}
+
+static PyObject *
+py_connection_fire(ConnectionObject *self, PyObject *args, PyObject *kwargs) {
+    PyObject *group, *rest, *list;
+    int result;
+
+    if (PyTuple_GET_SIZE(args) < 1) {
+        PyErr_SetString(PyExc_TypeError, "fire() takes a group");
+        return NULL;
+    }
+    group = PyTuple_GET_ITEM(args, 0);
+    if ((list = hooks_get(self, group)) == NULL) {
+        Py_RETURN_NONE;
+    }
+    if ((rest = PyTuple_GetSlice(args, 1, PyTuple_GET_SIZE(args))) == NULL) {
+        return NULL;
+    }
+    result = fire_list(list, rest, kwargs);
+    Py_DECREF(rest);
+    if (result == -1) {
+        return NULL;
+    }
+    Py_RETURN_NONE;
+}
+
+static PyObject *
+py_connection_fire_and_forget(ConnectionObject *self, PyObject *args, PyObject *kwargs) {
+    PyObject *result;
+
+    if ((result = py_connection_fire(self, args, kwargs)) == NULL) {
+        return NULL;
+    }
+    Py_DECREF(result);
+    return py_connection_unhook_group(self, PyTuple_GET_ITEM(args, 0));
+}
+
+static PyObject *
+py_connection_fire_hook(ConnectionObject *self, PyObject *args, PyObject *kwargs) {
+    PyObject *rest, *result;
+
+    if (PyTuple_GET_SIZE(args) < 1) {
+        PyErr_SetString(PyExc_TypeError, "fire_hook() takes a hook");
+        return NULL;
+    }
+    if ((rest = PyTuple_GetSlice(args, 1, PyTuple_GET_SIZE(args))) == NULL) {
+        return NULL;
+    }
+    result = PyObject_Call(PyTuple_GET_ITEM(args, 0), rest, kwargs);
+    Py_DECREF(rest);
+    return result;
+}
+
+/* Queues */
+
+static PyObject *
+py_connection_is_paused(ConnectionObject *self, PyObject *queue) {
+    int index = queue_index(queue);
+
+    if (index == -1) {
+        return NULL;
+    }
+    return PyBool_FromLong(self->flags & (index == RECV ? RECV_PAUSED : SEND_PAUSED));
+}
+
+static PyObject *
+py_connection_pause(ConnectionObject *self, PyObject *queue) {
+    int index = queue_index(queue), paused;
+
+    if (index == -1) {
+        return NULL;
+    }
+    paused = index == RECV ? RECV_PAUSED : SEND_PAUSED;
+    if (!(self->flags & paused)) {
+        self->flags |= paused;
+        if (fire_group(self, HOOK_PAUSE, queue_names[index]) == -1) {
+            return NULL;
+        }
+    }
+    Py_RETURN_NONE;
+}
+
+static PyObject *
+py_connection_resume(ConnectionObject *self, PyObject *queue) {
+    int index = queue_index(queue), paused;
+
+    if (index == -1) {
+        return NULL;
+    }
+    paused = index == RECV ? RECV_PAUSED : SEND_PAUSED;
+    if (self->flags & paused) {
+        self->flags &= ~paused;
+        if (fire_group(self, HOOK_RESUME, queue_names[index]) == -1) {
+            return NULL;
+        }
+    }
+    Py_RETURN_NONE;
+}
+
+static PyObject *
+py_connection_queue_data(ConnectionObject *self, PyObject *args) {
+    PyObject *queue, *data, *limit;
+    Py_ssize_t size, low, high, send_limit;
+    int index, paused, watermark = 1;
+
+    if (!PyArg_ParseTuple(args, "OS|i", &queue, &data, &watermark)) {
+        return NULL;
+    }
+    if ((index = queue_index(queue)) == -1) {
+        return NULL;
+    }
+
+    size = self->queued[index] + PyString_GET_SIZE(data);
+    if (index == SEND) {
+        if ((limit = PyObject_GetAttr((PyObject *) self, str_send_limit)) == NULL) {
+            return NULL;
+        }
+        send_limit = limit == Py_None ? 0 : PyNumber_AsSsize_t(limit, NULL);
+        Py_DECREF(limit);
+        if (send_limit == -1 && PyErr_Occurred()) {
+            return NULL;
+        }
+        if (send_limit && size > send_limit) {
+            errno = ENOBUFS;
+            return PyErr_SetFromErrno(PyExc_IOError);
+        }
+    }
+
+    if (PyList_Append(buffer_get(self, index), data) == -1) {
+        return NULL;
+    }
+    self->queued[index] = size;
+
+    paused = index == RECV ? RECV_PAUSED : SEND_PAUSED;
+    if (watermark && !(self->flags & paused)) {
+        if (watermarks(self, index, &low, &high) == -1) {
+            return NULL;
+        }
+        if (size >= high) {
+            self->flags |= paused;
+            if (fire_group(self, HOOK_PAUSE, queue_names[index]) == -1) {
+                return NULL;
+            }
+        }
+    }
+    Py_RETURN_NONE;
+}
+
+/* Returns 1 if the queue was resumed, -1 on error */
+static int
+dequeue(ConnectionObject *self, int index, Py_ssize_t size) {
+    Py_ssize_t low, high;
+    int paused = index == RECV ? RECV_PAUSED : SEND_PAUSED;
+
+    self->queued[index] -= size;
+    if (!(self->flags & paused)) {
+        return 0;
+    }
+    if (watermarks(self, index, &low, &high) == -1) {
+        return -1;
+    }
+    if (self->queued[index] > low) {
+        return 0;
+    }
+    self->flags &= ~paused;
+    if (fire_group(self, HOOK_RESUME, queue_names[index]) == -1) {
+        return -1;
+    }
+    return 1;
+}
+
+static PyObject *
+py_connection_dequeue_data(ConnectionObject *self, PyObject *args) {
+    PyObject *queue;
+    Py_ssize_t size;
+    int index, resumed;
+
+    if (!PyArg_ParseTuple(args, "On", &queue, &size)) {
+        return NULL;
+    }
+    if ((index = queue_index(queue)) == -1) {
+        return NULL;
+    }
+    if ((resumed = dequeue(self, index, size)) == -1) {
+        return NULL;
+    }
+    return PyBool_FromLong(resumed);
+}
+
+/* Take up to size bytes (or everything) from the receive queue */
+static PyObject *
+take(ConnectionObject *self, Py_ssize_t size) {
+    PyObject *chunks, *data, *chunk, *rest, *empty, *result;
+    Py_ssize_t wanted, length;
+    int resumed;
+
+    chunks = buffer_get(self, RECV);
+    if (size < 0 || size >= self->queued[RECV]) {
+        if ((empty = PyString_FromString("")) == NULL) {
+            return NULL;
+        }
+        data = _PyString_Join(empty, chunks);
+        Py_DECREF(empty);
+        if (data == NULL || PyList_SetSlice(chunks, 0,
+            PyList_GET_SIZE(chunks), NULL) == -1) {
+            Py_XDECREF(data);
+            return NULL;
+        }
+    } else {
+        if ((data = PyString_FromStringAndSize(NULL, size)) == NULL) {
+            return NULL;
+        }
+        wanted = 0;
+        while (wanted < size && PyList_GET_SIZE(chunks)) {
+            chunk = PyList_GET_ITEM(chunks, 0);
+            length = PyString_GET_SIZE(chunk);
+            if (length > size - wanted) {
+                // Keep the part we don't need queued
+                length = size - wanted;
+                rest = PyString_FromStringAndSize(
+                    PyString_AS_STRING(chunk) + length,
+                    PyString_GET_SIZE(chunk) - length);
+                if (rest == NULL) {
+                    Py_DECREF(data);
+                    return NULL;
+                }
+                memcpy(PyString_AS_STRING(data) + wanted,
+                    PyString_AS_STRING(chunk), length);
+                PyList_SetItem(chunks, 0, rest);
+            } else {
+                memcpy(PyString_AS_STRING(data) + wanted,
+                    PyString_AS_STRING(chunk), length);
+                if (PyList_SetSlice(chunks, 0, 1, NULL) == -1) {
+                    Py_DECREF(data);
+                    return NULL;
+                }
+            }
+            wanted += length;
+        }
+        if (wanted < size && _PyString_Resize(&data, wanted) == -1) {
+            return NULL;
+        }
+    }
+
+    if (PyString_GET_SIZE(data)) {
+        if ((resumed = dequeue(self, RECV, PyString_GET_SIZE(data))) == -1) {
+            Py_DECREF(data);
+            return NULL;
+        }
+        if (resumed) {
+            // Resume reading from the socket
+            result = PyObject_CallMethodObjArgs((PyObject *) self,
+                str_update_state, NULL);
+            if (result == NULL) {
+                Py_DECREF(data);
+                return NULL;
+            }
+            Py_DECREF(result);
+        }
+    }
+    return data;
+}
+
+static PyObject *
+py_connection_read(ConnectionObject *self, PyObject *args) {
+    Py_ssize_t size = -1;
+
+    if (!PyArg_ParseTuple(args, "|n", &size)) {
+        return NULL;
+    }
+    return take(self, size);
+}
+
+static PyObject *
+py_connection_take_line(ConnectionObject *self, PyObject *unused) {
+    PyObject *chunks = buffer_get(self, RECV), *line, *chunk, *copy;
+    Py_ssize_t i, offset = 0, length;
+    const char *newline = NULL;
+    char *data;
+
+    if (chunks == NULL) {
+        return NULL;
+    }
+    for (i = 0; i < PyList_GET_SIZE(chunks); ++i) {
+        chunk = PyList_GET_ITEM(chunks, i);
+        newline = memchr(PyString_AS_STRING(chunk), '\n',
+            PyString_GET_SIZE(chunk));
+        if (newline != NULL) {
+            offset += newline - PyString_AS_STRING(chunk) + 1;
+            break;
+        }
+        offset += PyString_GET_SIZE(chunk);
+    }
+    if (newline == NULL) {
+        Py_RETURN_NONE;
+    }
+
+    if ((line = take(self, offset)) == NULL) {
+        return NULL;
+    }
+    // Drop the line ending, in place unless the string is a whole chunk
+    // someone else still holds on to
+    data = PyString_AS_STRING(line);
+    length = PyString_GET_SIZE(line) - 1;
+    if (length > 0 && data[length - 1] == '\r') {
+        length--;
+    }
+    if (Py_REFCNT(line) == 1) {
+        if (_PyString_Resize(&line, length) == -1) {
+            return NULL;
+        }
+        return line;
+    }
+    copy = PyString_FromStringAndSize(data, length);
+    Py_DECREF(line);
+    return copy;
+}
+
+/* Attributes */
+
+static PyObject *
+py_connection_get_socket(ConnectionObject *self, void *closure) {
+    PyObject *sock = self->socket ? self->socket : Py_None;
+
+    Py_INCREF(sock);
+    return sock;
+}
+
+static int
+py_connection_set_socket(ConnectionObject *self, PyObject *value, void *closure) {
+    PyObject *fileno;
+    int fd = -1;
+
+    if (value != NULL && value != Py_None) {
+        if ((fileno = PyObject_CallMethod(value, "fileno", NULL)) == NULL) {
+            return -1;
+        }
+        fd = (int) PyInt_AsLong(fileno);
+        Py_DECREF(fileno);
+        if (fd == -1 && PyErr_Occurred()) {
+            return -1;
+        }
+        Py_INCREF(value);
+    } else {
+        value = NULL;
+    }
+    Py_XDECREF(self->socket);
+    self->socket = value;
+    self->fd = fd;
+    return 0;
+}
+
+static PyObject *
+py_connection_get_fileno(ConnectionObject *self, void *closure) {
+    if (self->socket == NULL) {
+        Py_RETURN_NONE;
+    }
+    return PyInt_FromLong(self->fd);
+}
+
+static PyObject *
+py_connection_get_states(ConnectionObject *self, void *closure) {
+    if (!(self->flags & REGISTERED)) {
+        Py_RETURN_NONE;
+    }
+    return PyInt_FromLong(self->states);
+}
+
+static int
+py_connection_set_states(ConnectionObject *self, PyObject *value, void *closure) {
+    long states;
+
+    if (value == NULL || value == Py_None) {
+        self->flags &= ~REGISTERED;
+        self->states = 0;
+        return 0;
+    }
+    states = PyInt_AsLong(value);
+    if (states == -1 && PyErr_Occurred()) {
+        return -1;
+    }
+    self->states = (unsigned int) states;
+    self->flags |= REGISTERED;
+    return 0;
+}
+
+static PyObject *
+py_connection_get_flag(ConnectionObject *self, void *closure) {
+    return PyBool_FromLong(self->flags & (unsigned int) (Py_intptr_t) closure);
+}
+
+static int
+py_connection_set_flag(ConnectionObject *self, PyObject *value, void *closure) {
+    int truth;
+
+    if (value == NULL) {
+        PyErr_SetString(PyExc_AttributeError, "can't delete flag");
+        return -1;
+    }
+    if ((truth = PyObject_IsTrue(value)) == -1) {
+        return -1;
+    }
+    if (truth) {
+        self->flags |= (unsigned int) (Py_intptr_t) closure;
+    } else {
+        self->flags &= ~(unsigned int) (Py_intptr_t) closure;
+    }
+    return 0;
+}
+
+static PyObject *
+py_connection_get_is_reading(ConnectionObject *self, void *closure) {
+    return PyBool_FromLong(self->hooks[HOOK_RECV]
+        && PyList_GET_SIZE(self->hooks[HOOK_RECV])
+        && !(self->flags & RECV_PAUSED));
+}
+
+static PyObject *
+py_connection_get_is_sending(ConnectionObject *self, void *closure) {
+    return PyBool_FromLong(self->buffers[SEND]
+        && PyList_GET_SIZE(self->buffers[SEND]));
+}
+
+static PyObject *
+py_connection_get_queued(ConnectionObject *self, void *closure) {
+    return Py_BuildValue("{snsn}",
+        "recv", self->queued[RECV],
+        "send", self->queued[SEND]);
+}
+
+static PyObject *
+py_connection_get_paused(ConnectionObject *self, void *closure) {
+    PyObject *paused;
+
+    if ((paused = PySet_New(NULL)) == NULL) {
+        return NULL;
+    }
+    if ((self->flags & RECV_PAUSED && PySet_Add(paused, queue_names[RECV]) == -1)
+        || (self->flags & SEND_PAUSED && PySet_Add(paused, queue_names[SEND]) == -1)) {
+        Py_DECREF(paused);
+        return NULL;
+    }
+    return paused;
+}
+
+static PyObject *
+py_connection_get_buffer_queue(ConnectionObject *self, void *closure) {
+    PyObject *list = buffer_get(self, (int) (Py_intptr_t) closure);
+
+    Py_XINCREF(list);
+    return list;
+}
+
+static PyObject *
+py_connection_get_buffer(ConnectionObject *self, void *closure) {
+    PyObject *recv = buffer_get(self, RECV), *send = buffer_get(self, SEND);
+
+    if (recv == NULL || send == NULL) {
+        return NULL;
+    }
+    return Py_BuildValue("{sOsO}", "recv", recv, "send", send);
+}
+
+static PyObject *
+py_connection_get_hooks(ConnectionObject *self, void *closure) {
+    PyObject *hooks;
+    int i;
+
+    if (self->extra_hooks) {
+        hooks = PyDict_Copy(self->extra_hooks);
+    } else {
+        hooks = PyDict_New();
+    }
+    if (hooks == NULL) {
+        return NULL;
+    }
+    for (i = 0; i < HOOK_SLOTS; ++i) {
+        if (self->hooks[i] == NULL) {
+            continue;
+        }
+        if (PyDict_SetItem(hooks, hook_groups[i], self->hooks[i]) == -1) {
+            Py_DECREF(hooks);
+            return NULL;
+        }
+    }
+    return hooks;
+}
+
+static PyMethodDef Connection_methods[] = {
+    {"hook",            (PyCFunction) py_connection_hook,            METH_VARARGS | METH_KEYWORDS, hook__doc__},
+    {"unhook",          (PyCFunction) py_connection_unhook,          METH_VARARGS,                 unhook__doc__},
+    {"unhook_group",    (PyCFunction) py_connection_unhook_group,    METH_O,                       unhook_group__doc__},
+    {"fire",            (PyCFunction) py_connection_fire,            METH_VARARGS | METH_KEYWORDS, fire__doc__},
+    {"fire_and_forget", (PyCFunction) py_connection_fire_and_forget, METH_VARARGS | METH_KEYWORDS, fire_and_forget__doc__},
+    {"fire_hook",       (PyCFunction) py_connection_fire_hook,       METH_VARARGS | METH_KEYWORDS, fire_hook__doc__},
+    {"is_paused",       (PyCFunction) py_connection_is_paused,       METH_O,                       is_paused__doc__},
+    {"pause",           (PyCFunction) py_connection_pause,           METH_O,                       pause__doc__},
+    {"resume",          (PyCFunction) py_connection_resume,          METH_O,                       resume__doc__},
+    {"queue_data",      (PyCFunction) py_connection_queue_data,      METH_VARARGS,                 queue_data__doc__},
+    {"dequeue_data",    (PyCFunction) py_connection_dequeue_data,    METH_VARARGS,                 dequeue_data__doc__},
+    {"read",            (PyCFunction) py_connection_read,            METH_VARARGS,                 read__doc__},
+    {"take_line",       (PyCFunction) py_connection_take_line,       METH_NOARGS,                  take_line__doc__},
+    {NULL, NULL} /* sentinel */
+};
+
+static PyMemberDef Connection_members[] = {
+    {"async",      T_OBJECT,    offsetof(ConnectionObject, async),      0, NULL},
+    {"address",    T_OBJECT,    offsetof(ConnectionObject, address),    0, NULL},
+    {"blocksize",  T_INT,       offsetof(ConnectionObject, blocksize),  0, NULL},
+    {"recv_calls", T_PYSSIZET,  offsetof(ConnectionObject, recv_calls), 0, NULL},
+    {"recv_bytes", T_PYSSIZET,  offsetof(ConnectionObject, recv_bytes), 0, NULL},
+    {"send_calls", T_PYSSIZET,  offsetof(ConnectionObject, send_calls), 0, NULL},
+    {"send_bytes", T_PYSSIZET,  offsetof(ConnectionObject, send_bytes), 0, NULL},
+    {"recv_queued", T_PYSSIZET, offsetof(ConnectionObject, queued) + RECV * sizeof(Py_ssize_t), READONLY, NULL},
+    {"send_queued", T_PYSSIZET, offsetof(ConnectionObject, queued) + SEND * sizeof(Py_ssize_t), READONLY, NULL},
+    {"waiter",     T_OBJECT,    offsetof(ConnectionObject, waiter),     0, NULL},
+    {"candidates", T_OBJECT,    offsetof(ConnectionObject, candidates), 0, NULL},
+    {NULL} /* sentinel */
+};
+
+static PyGetSetDef Connection_getset[] = {
+    {"socket",      (getter) py_connection_get_socket,       (setter) py_connection_set_socket, NULL, NULL},
+    {"fileno",      (getter) py_connection_get_fileno,       NULL, NULL, NULL},
+    {"states",      (getter) py_connection_get_states,       (setter) py_connection_set_states, NULL, NULL},
+    {"connected",   (getter) py_connection_get_flag,         (setter) py_connection_set_flag, NULL, (void *) CONNECTED},
+    {"connecting",  (getter) py_connection_get_flag,         (setter) py_connection_set_flag, NULL, (void *) CONNECTING},
+    {"retain",      (getter) py_connection_get_flag,         (setter) py_connection_set_flag, NULL, (void *) RETAIN},
+    {"dirty",       (getter) py_connection_get_flag,         (setter) py_connection_set_flag, NULL, (void *) DIRTY},
+    {"corked",      (getter) py_connection_get_flag,         (setter) py_connection_set_flag, NULL, (void *) CORKED},
+    {"is_reading",  (getter) py_connection_get_is_reading,   NULL, NULL, NULL},
+    {"is_sending",  (getter) py_connection_get_is_sending,   NULL, NULL, NULL},
+    {"queued",      (getter) py_connection_get_queued,       NULL, NULL, NULL},
+    {"paused",      (getter) py_connection_get_paused,       NULL, NULL, NULL},
+    {"recv_buffer", (getter) py_connection_get_buffer_queue, NULL, NULL, (void *) RECV},
+    {"send_buffer", (getter) py_connection_get_buffer_queue, NULL, NULL, (void *) SEND},
+    {"buffer",      (getter) py_connection_get_buffer,       NULL, NULL, NULL},
+    {"hooks",       (getter) py_connection_get_hooks,        NULL, NULL, NULL},
+    {NULL} /* sentinel */
+};
+
+static PyTypeObject ConnectionType = {
+    PyObject_HEAD_INIT(NULL)
+    0,                          /* ob_size */
+    "_connection.Connection",   /* tp_name */
+    sizeof(ConnectionObject),   /* tp_basicsize */
+    0,                          /* tp_itemsize */
+    (destructor) py_connection_dealloc, /* tp_dealloc */
+    0,                          /* tp_print */
+    0,                          /* tp_getattr */
+    0,                          /* tp_setattr */
+    0,                          /* tp_compare */
+    0,                          /* tp_repr */
+    0,                          /* tp_as_number */
+    0,                          /* tp_as_sequence */
+    0,                          /* tp_as_mapping */
+    0,                          /* tp_hash */
+    0,                          /* tp_call */
+    0,                          /* tp_str */
+    0,                          /* tp_getattro */
+    0,                          /* tp_setattro */
+    0,                          /* tp_as_buffer */
+    Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE | Py_TPFLAGS_HAVE_GC, /* tp_flags */
+    Connection__doc__,          /* tp_doc */
+    (traverseproc) py_connection_traverse, /* tp_traverse */
+    (inquiry) py_connection_clear, /* tp_clear */
+    0,                          /* tp_richcompare */
+    0,                          /* tp_weaklistoffset */
+    0,                          /* tp_iter */
+    0,                          /* tp_iternext */
+    Connection_methods,         /* tp_methods */
+    Connection_members,         /* tp_members */
+    Connection_getset,          /* tp_getset */
+    0,                          /* tp_base */
+    0,                          /* tp_dict */
+    0,                          /* tp_descr_get */
+    0,                          /* tp_descr_set */
+    0,                          /* tp_dictoffset */
+    (initproc) py_connection_init, /* tp_init */
+    0,                          /* tp_alloc */
+    py_connection_new,          /* tp_new */
+};
+
+static PyMethodDef _connection_methods[] = {
+    {NULL, NULL} /* sentinel */
+};
+
+PyMODINIT_FUNC
+init_connection(void) {
+    PyObject *m, *type = (PyObject *) &ConnectionType;
+    int i;
+
+    for (i = 0; i < HOOK_SLOTS; ++i) {
+        if ((hook_groups[i] = PyString_InternFromString(hook_names[i])) == NULL)
+            return;
+    }
+    queue_names[RECV] = hook_groups[HOOK_RECV];
+    queue_names[SEND] = hook_groups[HOOK_SEND];
+    str_watermarks   = PyString_InternFromString("watermarks");
+    str_send_limit   = PyString_InternFromString("send_limit");
+    str_update_state = PyString_InternFromString("update_state");
+    if (!str_watermarks || !str_send_limit || !str_update_state)
+        return;
+
+    if (PyType_Ready(&ConnectionType) < 0)
+        return;
+
+    m = Py_InitModule3("_connection", _connection_methods,
+        _connection__doc__);
+    if (m == NULL)
+        return;
+
+    Py_INCREF(type);
+    PyModule_AddObject(m, "Connection", type);
+}
@@ -1,6 +1,9 @@
 #include <Python.h>
 #include <strings.h>
 #include <sys/epoll.h>
+#include <time.h>
+
+#include "histogram.h"
 
 /* The module doc string */
 PyDoc_STRVAR(_epoll__doc__, "I/O event notification facility for Linux");
@@ -8,13 +11,106 @@ PyDoc_STRVAR(_epoll__doc__, "I/O event notification facility for Linux");
 /* The function doc string */
 PyDoc_STRVAR(create__doc__,  "create([maxevents]) -> epollfd\n\nOpen an epoll descriptor.");
 PyDoc_STRVAR(control__doc__, "control(epollfd, op, fd, events) -> errno\n\nControl interface for an epoll descriptor.");
-PyDoc_STRVAR(wait__doc__,    "wait(epollfd, timeout[, maxevents]) -> events\n\nWait for an I/O event on an epoll descriptor.");
+PyDoc_STRVAR(wait__doc__,    "wait(epollfd, timeout[, maxevents[, spin_us]]) -> events\n\nWait for an I/O event on an epoll descriptor, busy polling for up to spin_us\nmicroseconds before blocking.");
+PyDoc_STRVAR(stats__doc__,   "stats() -> dict\n\nCounters and histograms of all waits so far.");
 
 // Chosen by fair guesstimation
 #ifndef MAX_EVENTS
 #define MAX_EVENTS 1024
 #endif
 
+#define STATS_KEYS 7
+
+/* Module state: interned stats keys and the always-on instrumentation of
+ * epoll_wait */
+static struct {
+    PyObject *keys[STATS_KEYS];
+    unsigned long long waits;
+    unsigned long long wakeups;
+    unsigned long long events;
+    // Zero timeout polls made while busy polling, and the waits they served
+    unsigned long long spins;
+    unsigned long long spin_hits;
+    histogram_t wait_us;
+    histogram_t events_per_wakeup;
+} state;
+
+static const char *stats_keys[STATS_KEYS] = {
+    "waits", "wakeups", "events", "spins", "spin_hits", "wait_us",
+    "events_per_wakeup"
+};
+
+static inline unsigned long long
+now_us(void) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (unsigned long long) now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+/* Argument unpacking for the hot paths, skips the format string parsing */
+
+static inline int
+int_arg(PyObject *args, Py_ssize_t i, long *value) {
+    PyObject *item = PyTuple_GET_ITEM(args, i);
+
+    if (PyInt_CheckExact(item)) {
+        *value = PyInt_AS_LONG(item);
+        return 0;
+    }
+    if ((*value = PyInt_AsLong(item)) == -1 && PyErr_Occurred()) {
+        return -1;
+    }
+    return 0;
+}
+
+static int
+int_args(PyObject *args, Py_ssize_t required, Py_ssize_t optional,
+    long *values) {
+    Py_ssize_t i, size = PyTuple_GET_SIZE(args);
+
+    if (size < required || size > required + optional) {
+        PyErr_Format(PyExc_TypeError, "expected %zd to %zd arguments, got %zd",
+            required, required + optional, size);
+        return -1;
+    }
+    for (i = 0; i < size; ++i) {
+        if (int_arg(args, i, &values[i]) == -1) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* Poll without blocking until something is ready or spin_us have passed, then
+ * block for what is left of the timeout. Called without the GIL. */
+static int
+spin_wait(int epollfd, struct epoll_event *events, int maxevents, int timeout,
+    long spin_us, unsigned long long *spins, int *hit) {
+    unsigned long long start = now_us(), elapsed;
+    int size;
+
+    do {
+        (*spins)++;
+        if ((size = epoll_wait(epollfd, events, maxevents, 0)) != 0) {
+            *hit = size > 0;
+            return size;
+        }
+        elapsed = now_us() - start;
+    } while (elapsed < (unsigned long long) spin_us);
+
+    if (timeout > 0) {
+        timeout -= (int) (elapsed / 1000);
+        if (timeout < 0) {
+            timeout = 0;
+        }
+    }
+    if (timeout == 0) {
+        return 0;
+    }
+    return epoll_wait(epollfd, events, maxevents, timeout);
+}
+
 /* The wrapper to the underlying C functions */
 
 static PyObject *
@@ -32,59 +128,122 @@ py_epoll_create(PyObject *self, PyObject *args) {
 
 static PyObject *
 py_epoll_control(PyObject *self, PyObject *args) {
-    int epollfd, op, fd, events;
+    // epollfd, op, fd, events
+    long values[4];
     struct epoll_event event;
 
-    if (!PyArg_ParseTuple(args, "iiiI", &epollfd, &op, &fd, &events)) {
+    if (int_args(args, 4, 0, values) == -1) {
         return NULL;
     }
 
     bzero(&event, sizeof(struct epoll_event));
-    event.events = events;
-    event.data.fd = fd;
-    return Py_BuildValue("i", epoll_ctl(epollfd, op, fd, &event));
+    event.events = (uint32_t) values[3];
+    event.data.fd = (int) values[2];
+    return PyInt_FromLong(epoll_ctl((int) values[0], (int) values[1],
+        (int) values[2], &event));
 }
 
 static PyObject *
 py_epoll_wait(PyObject *self, PyObject *args) {
-    int epollfd, maxevents = MAX_EVENTS, timeout, size, i;
+    // epollfd, timeout, maxevents, spin_us
+    long values[4] = {-1, 0, MAX_EVENTS, 0};
+    int maxevents, size, i, hit = 0;
+    unsigned long long start, spins = 0;
     struct epoll_event events[MAX_EVENTS];
+    PyObject *list, *tuple, *fd, *mask;
 
-    if (!PyArg_ParseTuple(args, "ii|i", &epollfd, &timeout, &maxevents)) {
+    if (int_args(args, 2, 2, values) == -1) {
         return NULL;
     }
 
+    maxevents = (int) values[2];
+    if (maxevents <= 0 || maxevents > MAX_EVENTS) {
+        maxevents = MAX_EVENTS;
+    }
+
     // Satisfy the GIL, we're going to block...
+    start = now_us();
     Py_BEGIN_ALLOW_THREADS
-    size = epoll_wait(epollfd, events, maxevents, timeout);
+    if (values[3] > 0 && values[1] != 0) {
+        size = spin_wait((int) values[0], events, maxevents, (int) values[1],
+            values[3], &spins, &hit);
+    } else {
+        size = epoll_wait((int) values[0], events, maxevents, (int) values[1]);
+    }
     Py_END_ALLOW_THREADS
     if (size == -1) {
         PyErr_SetFromErrno(PyExc_Exception);
         return NULL;
     }
 
-    PyObject *list = PyList_New(size);
-    PyObject *tuple;
+    state.spins += spins;
+    state.spin_hits += hit;
+    state.waits++;
+    histogram_record(&state.wait_us, now_us() - start);
+    if (size > 0) {
+        state.wakeups++;
+        state.events += size;
+        histogram_record(&state.events_per_wakeup, size);
+    }
+
+    if ((list = PyList_New(size)) == NULL) {
+        return NULL;
+    }
     for (i = 0; i < size; ++i) {
-        tuple = PyTuple_New(2);
-        PyTuple_SET_ITEM(tuple, 0, PyInt_FromLong(events[i].data.fd));
-        PyTuple_SET_ITEM(tuple, 1, PyInt_FromLong(events[i].events));
+        fd = PyInt_FromLong(events[i].data.fd);
+        mask = PyInt_FromLong(events[i].events);
+        if (fd == NULL || mask == NULL || (tuple = PyTuple_New(2)) == NULL) {
+            Py_XDECREF(fd);
+            Py_XDECREF(mask);
+            Py_DECREF(list);
+            return NULL;
+        }
+        PyTuple_SET_ITEM(tuple, 0, fd);
+        PyTuple_SET_ITEM(tuple, 1, mask);
         PyList_SET_ITEM(list, i, tuple);
     }
 
     return list;
 }
 
+static PyObject *
+py_epoll_stats(PyObject *self, PyObject *unused) {
+    PyObject *values[STATS_KEYS], *result;
+    int i;
+
+    values[0] = PyLong_FromUnsignedLongLong(state.waits);
+    values[1] = PyLong_FromUnsignedLongLong(state.wakeups);
+    values[2] = PyLong_FromUnsignedLongLong(state.events);
+    values[3] = PyLong_FromUnsignedLongLong(state.spins);
+    values[4] = PyLong_FromUnsignedLongLong(state.spin_hits);
+    values[5] = histogram_snapshot(&state.wait_us);
+    values[6] = histogram_snapshot(&state.events_per_wakeup);
+
+    result = PyDict_New();
+    for (i = 0; i < STATS_KEYS; ++i) {
+        if (result != NULL && (values[i] == NULL
+            || PyDict_SetItem(result, state.keys[i], values[i]) == -1)) {
+            Py_CLEAR(result);
+        }
+    }
+    for (i = 0; i < STATS_KEYS; ++i) {
+        Py_XDECREF(values[i]);
+    }
+    return result;
+}
+
 static PyMethodDef _epoll_methods[] = {
     {"create",  py_epoll_create,  METH_VARARGS, create__doc__},
     {"control", py_epoll_control, METH_VARARGS, control__doc__},
     {"wait",    py_epoll_wait,    METH_VARARGS, wait__doc__},
+    {"stats",   py_epoll_stats,   METH_NOARGS,  stats__doc__},
     {NULL, NULL} /* sentinel */
 };
 
 PyMODINIT_FUNC
 init_epoll(void) {
     PyObject *m;
+    int i;
     static PyObject *_MAX_EVENTS, *_EPOLL_CTL_ADD, *_EPOLL_CTL_DEL, *_EPOLL_CTL_MOD;
 
     m = Py_InitModule3("_epoll", _epoll_methods,
@@ -92,6 +251,11 @@ init_epoll(void) {
     if (m == NULL)
         return;
 
+    for (i = 0; i < STATS_KEYS; ++i) {
+        if ((state.keys[i] = PyString_InternFromString(stats_keys[i])) == NULL)
+            return;
+    }
+
     _MAX_EVENTS    = Py_BuildValue("i", MAX_EVENTS);
     _EPOLL_CTL_ADD = Py_BuildValue("i", EPOLL_CTL_ADD);
     _EPOLL_CTL_DEL = Py_BuildValue("i", EPOLL_CTL_DEL);
@@ -0,0 +1,164 @@
+#include <Python.h>
+#include <time.h>
+
+#include "histogram.h"
+
+/* The module doc string */
+PyDoc_STRVAR(_stats__doc__, "Low overhead event loop instrumentation");
+
+/* The function doc string */
+PyDoc_STRVAR(now__doc__,        "now() -> microseconds\n\nMonotonic clock in microseconds.");
+PyDoc_STRVAR(Histogram__doc__,  "Histogram()\n\nLog bucketed histogram of non-negative integers.");
+PyDoc_STRVAR(record__doc__,     "record(value)\n\nCount a value.");
+PyDoc_STRVAR(percentile__doc__, "percentile(p) -> value\n\nHighest value equivalent to the p-th percentile.");
+PyDoc_STRVAR(snapshot__doc__,   "snapshot() -> dict\n\nCounters, percentiles and non-empty buckets.");
+PyDoc_STRVAR(reset__doc__,      "reset()\n\nForget all values.");
+
+typedef struct {
+    PyObject_HEAD
+    histogram_t histogram;
+} HistogramObject;
+
+static PyObject *
+py_stats_now(PyObject *self, PyObject *unused) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return PyLong_FromUnsignedLongLong(
+        (histogram_value) now.tv_sec * 1000000 + now.tv_nsec / 1000);
+}
+
+static PyObject *
+py_histogram_new(PyTypeObject *type, PyObject *args, PyObject *kwargs) {
+    HistogramObject *self;
+
+    if ((self = (HistogramObject *) type->tp_alloc(type, 0)) == NULL) {
+        return NULL;
+    }
+    histogram_reset(&self->histogram);
+    return (PyObject *) self;
+}
+
+static PyObject *
+py_histogram_record(HistogramObject *self, PyObject *value) {
+    histogram_value v;
+
+    if (PyFloat_Check(value)) {
+        double d = PyFloat_AS_DOUBLE(value);
+        v = d > 0 ? (histogram_value) d : 0;
+    } else if (PyInt_Check(value)) {
+        long l = PyInt_AS_LONG(value);
+        v = l > 0 ? (histogram_value) l : 0;
+    } else {
+        v = PyLong_AsUnsignedLongLong(value);
+        if (v == (histogram_value) -1 && PyErr_Occurred()) {
+            return NULL;
+        }
+    }
+
+    histogram_record(&self->histogram, v);
+    Py_RETURN_NONE;
+}
+
+static PyObject *
+py_histogram_percentile(HistogramObject *self, PyObject *args) {
+    double percentile;
+
+    if (!PyArg_ParseTuple(args, "d", &percentile)) {
+        return NULL;
+    }
+    return PyLong_FromUnsignedLongLong(
+        histogram_percentile(&self->histogram, percentile));
+}
+
+static PyObject *
+py_histogram_snapshot(HistogramObject *self, PyObject *unused) {
+    return histogram_snapshot(&self->histogram);
+}
+
+static PyObject *
+py_histogram_reset(HistogramObject *self, PyObject *unused) {
+    histogram_reset(&self->histogram);
+    Py_RETURN_NONE;
+}
+
+static PyObject *
+py_histogram_count(HistogramObject *self, void *closure) {
+    return PyLong_FromUnsignedLongLong(self->histogram.count);
+}
+
+static PyMethodDef Histogram_methods[] = {
+    {"record",     (PyCFunction) py_histogram_record,     METH_O,       record__doc__},
+    {"percentile", (PyCFunction) py_histogram_percentile, METH_VARARGS, percentile__doc__},
+    {"snapshot",   (PyCFunction) py_histogram_snapshot,   METH_NOARGS,  snapshot__doc__},
+    {"reset",      (PyCFunction) py_histogram_reset,      METH_NOARGS,  reset__doc__},
+    {NULL, NULL} /* sentinel */
+};
+
+static PyGetSetDef Histogram_getset[] = {
+    {"count", (getter) py_histogram_count, NULL, NULL, NULL},
+    {NULL} /* sentinel */
+};
+
+static PyTypeObject HistogramType = {
+    PyObject_HEAD_INIT(NULL)
+    0,                          /* ob_size */
+    "_stats.Histogram",         /* tp_name */
+    sizeof(HistogramObject),    /* tp_basicsize */
+    0,                          /* tp_itemsize */
+    0,                          /* tp_dealloc */
+    0,                          /* tp_print */
+    0,                          /* tp_getattr */
+    0,                          /* tp_setattr */
+    0,                          /* tp_compare */
+    0,                          /* tp_repr */
+    0,                          /* tp_as_number */
+    0,                          /* tp_as_sequence */
+    0,                          /* tp_as_mapping */
+    0,                          /* tp_hash */
+    0,                          /* tp_call */
+    0,                          /* tp_str */
+    0,                          /* tp_getattro */
+    0,                          /* tp_setattro */
+    0,                          /* tp_as_buffer */
+    Py_TPFLAGS_DEFAULT,         /* tp_flags */
+    Histogram__doc__,           /* tp_doc */
+    0,                          /* tp_traverse */
+    0,                          /* tp_clear */
+    0,                          /* tp_richcompare */
+    0,                          /* tp_weaklistoffset */
+    0,                          /* tp_iter */
+    0,                          /* tp_iternext */
+    Histogram_methods,          /* tp_methods */
+    0,                          /* tp_members */
+    Histogram_getset,           /* tp_getset */
+    0,                          /* tp_base */
+    0,                          /* tp_dict */
+    0,                          /* tp_descr_get */
+    0,                          /* tp_descr_set */
+    0,                          /* tp_dictoffset */
+    0,                          /* tp_init */
+    0,                          /* tp_alloc */
+    py_histogram_new,           /* tp_new */
+};
+
+static PyMethodDef _stats_methods[] = {
+    {"now", py_stats_now, METH_NOARGS, now__doc__},
+    {NULL, NULL} /* sentinel */
+};
+
+PyMODINIT_FUNC
+init_stats(void) {
+    PyObject *m, *type = (PyObject *) &HistogramType;
+
+    if (PyType_Ready(&HistogramType) < 0)
+        return;
+
+    m = Py_InitModule3("_stats", _stats_methods,
+        _stats__doc__);
+    if (m == NULL)
+        return;
+
+    Py_INCREF(type);
+    PyModule_AddObject(m, "Histogram", type);
+}
@@ -0,0 +1,137 @@
+/*
+ * Log bucketed histogram shared by the C extensions.
+ *
+ * Every power of two is split in (1 << HISTOGRAM_SUB_BITS) linear sub buckets,
+ * values below that are counted exactly. With 3 sub bits the relative error is
+ * at most 12.5% over the whole 64 bit range, at a fixed 4 KiB per histogram.
+ */
+#ifndef NET_HISTOGRAM_H
+#define NET_HISTOGRAM_H
+
+#include <Python.h>
+#include <string.h>
+
+#define HISTOGRAM_SUB_BITS 3
+#define HISTOGRAM_SUB      (1 << HISTOGRAM_SUB_BITS)
+#define HISTOGRAM_BUCKETS  (64 << HISTOGRAM_SUB_BITS)
+
+typedef unsigned long long histogram_value;
+
+typedef struct {
+    histogram_value count;
+    histogram_value sum;
+    histogram_value min;
+    histogram_value max;
+    histogram_value buckets[HISTOGRAM_BUCKETS];
+} histogram_t;
+
+static inline int
+histogram_index(histogram_value value) {
+    int msb;
+
+    if (value < HISTOGRAM_SUB) {
+        return (int) value;
+    }
+    msb = 63 - __builtin_clzll(value);
+    return ((msb - HISTOGRAM_SUB_BITS + 1) << HISTOGRAM_SUB_BITS)
+        | (int) ((value >> (msb - HISTOGRAM_SUB_BITS)) & (HISTOGRAM_SUB - 1));
+}
+
+/* Highest value that is counted in bucket index */
+static inline histogram_value
+histogram_upper(int index) {
+    int shift;
+
+    if (index < HISTOGRAM_SUB) {
+        return (histogram_value) index;
+    }
+    shift = (index >> HISTOGRAM_SUB_BITS) - 1;
+    return ((((histogram_value) (HISTOGRAM_SUB | (index & (HISTOGRAM_SUB - 1))))
+        + 1) << shift) - 1;
+}
+
+static inline void
+histogram_reset(histogram_t *h) {
+    memset(h, 0, sizeof(histogram_t));
+}
+
+static inline void
+histogram_record(histogram_t *h, histogram_value value) {
+    if (h->count == 0 || value < h->min) {
+        h->min = value;
+    }
+    if (value > h->max) {
+        h->max = value;
+    }
+    h->count++;
+    h->sum += value;
+    h->buckets[histogram_index(value)]++;
+}
+
+static histogram_value
+histogram_percentile(histogram_t *h, double percentile) {
+    histogram_value wanted, seen = 0;
+    int i;
+
+    if (h->count == 0) {
+        return 0;
+    }
+    wanted = (histogram_value) (h->count * percentile / 100.0 + 0.5);
+    if (wanted < 1) {
+        wanted = 1;
+    }
+    for (i = 0; i < HISTOGRAM_BUCKETS; ++i) {
+        seen += h->buckets[i];
+        if (seen >= wanted) {
+            return histogram_upper(i) < h->max ? histogram_upper(i) : h->max;
+        }
+    }
+    return h->max;
+}
+
+/* Snapshot as a dict with the usual percentiles and the non-empty buckets */
+static PyObject *
+histogram_snapshot(histogram_t *h) {
+    static const double percentiles[] = {50.0, 90.0, 99.0, 99.9};
+    static const char *names[] = {"p50", "p90", "p99", "p99.9"};
+    PyObject *result, *buckets, *item;
+    int i;
+
+    if ((buckets = PyList_New(0)) == NULL) {
+        return NULL;
+    }
+    for (i = 0; i < HISTOGRAM_BUCKETS; ++i) {
+        if (h->buckets[i] == 0) {
+            continue;
+        }
+        item = Py_BuildValue("(KK)", histogram_upper(i), h->buckets[i]);
+        if (item == NULL || PyList_Append(buckets, item) == -1) {
+            Py_XDECREF(item);
+            Py_DECREF(buckets);
+            return NULL;
+        }
+        Py_DECREF(item);
+    }
+
+    result = Py_BuildValue("{sKsKsKsKsN}",
+        "count", h->count,
+        "sum",   h->sum,
+        "min",   h->min,
+        "max",   h->max,
+        "buckets", buckets);
+    if (result == NULL) {
+        return NULL;
+    }
+    for (i = 0; i < 4; ++i) {
+        item = PyLong_FromUnsignedLongLong(histogram_percentile(h, percentiles[i]));
+        if (item == NULL || PyDict_SetItemString(result, names[i], item) == -1) {
+            Py_XDECREF(item);
+            Py_DECREF(result);
+            return NULL;
+        }
+        Py_DECREF(item);
+    }
+    return result;
+}
+
+#endif
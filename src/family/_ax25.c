@@ -8,198 +8,253 @@
 
 #include <netax25/axlib.h>
 
-/* The module exception */
-static PyObject *AX25Error;
+/* Module state, the exception is an IOError so errno survives */
+static struct {
+    PyObject *error;
+} state;
 
 /* The module doc string */
 PyDoc_STRVAR(_ax25__doc__, "AX.25 protocol functions.");
 
 /* The function doc string */
+PyDoc_STRVAR(null_address__doc__, "null_address() -> addr\n\nThe all blank network address.");
 PyDoc_STRVAR(aton__doc__,     "aton(call) -> addr\n\nConvert call sign to network address.");
 PyDoc_STRVAR(ntoa__doc__,     "ntoa(addr) -> call\n\nConvert network address to call sign.");
 PyDoc_STRVAR(socket__doc__,   "socket([type]) -> socket\n\nCreate an AX.25 socket.");
-PyDoc_STRVAR(accept__doc__,   "accept() -> (conn, address)\n\nAccept a connection.");
+PyDoc_STRVAR(accept__doc__,   "accept(fd[, flags]) -> (address, conn)\n\nAccept a connection, flags may hold SOCK_NONBLOCK and SOCK_CLOEXEC.");
 PyDoc_STRVAR(bind__doc__,     "bind(fd, call)\n\nBind socket to listen for connections to call.");
-PyDoc_STRVAR(recvfrom__doc__, "recvfrom(fd, len, flags)\n\nReceive message from another socket.");
-PyDoc_STRVAR(sendto__doc__,   "sendto(fd, buf, len, flags, addr)\n\nTransmit message to another socket.");
+PyDoc_STRVAR(recvfrom__doc__, "recvfrom(fd, len[, flags]) -> (data, address)\n\nReceive message from another socket.");
+PyDoc_STRVAR(sendto__doc__,   "sendto(fd, buf, len, flags, addr) -> size\n\nTransmit message to another socket.");
 PyDoc_STRVAR(validate__doc__, "validate(addr) -> bool\n\nValidate an AX.25 network address.");
 
 /* The wrapper to the underlying C functions */
 static PyObject *
-py_ax25_null_address(PyObject *self, PyObject *args) {
-    return Py_BuildValue("s", null_ax25_address.ax25_call);
+py_ax25_null_address(PyObject *self, PyObject *unused) {
+    return PyString_FromStringAndSize(null_ax25_address.ax25_call,
+        sizeof(ax25_address));
+}
+
+// Single string arguments, without embedded NUL bytes like "s" wants them
+static const char *
+string_arg(PyObject *arg) {
+    if (!PyString_Check(arg)
+        || strlen(PyString_AS_STRING(arg)) != (size_t) PyString_GET_SIZE(arg)) {
+        return NULL;
+    }
+    return PyString_AS_STRING(arg);
 }
 
 static PyObject *
-py_ax25_aton(PyObject *self, PyObject *args) {
+py_ax25_aton(PyObject *self, PyObject *arg) {
     const char *call;
     struct full_sockaddr_ax25 dest;
 
-    if (!PyArg_ParseTuple(args, "s", &call)) {
-        PyErr_SetString(AX25Error, "Call argument required");
+    if ((call = string_arg(arg)) == NULL) {
+        PyErr_SetString(state.error, "Call argument required");
         return NULL;
     }
 
     if (ax25_aton(call, &dest) == -1) {
-        PyErr_SetString(AX25Error, "Malformed AX.25 call sign");
+        PyErr_SetString(state.error, "Malformed AX.25 call sign");
         return NULL;
     } else {
-        return Py_BuildValue("s", dest.fsa_ax25.sax25_call.ax25_call);
+        return PyString_FromStringAndSize(dest.fsa_ax25.sax25_call.ax25_call,
+            sizeof(ax25_address));
     }
 }
 
 static PyObject *
-py_ax25_ntoa(PyObject *self, PyObject *args) {
+py_ax25_ntoa(PyObject *self, PyObject *arg) {
     const char *call, *temp;
-    ax25_address *from = (ax25_address *) malloc(sizeof(ax25_address));
+    Py_ssize_t len;
+    ax25_address from;
+
+    if (PyString_CheckExact(arg)) {
+        temp = PyString_AS_STRING(arg);
+        len = PyString_GET_SIZE(arg);
+    } else if (PyObject_AsCharBuffer(arg, &temp, &len) == -1) {
+        PyErr_SetString(state.error, "Call argument required");
+        return NULL;
+    }
 
-    if (!PyArg_ParseTuple(args, "s", &temp)) {
-        PyErr_SetString(AX25Error, "Call argument required");
+    if (len != sizeof(ax25_address)) {
+        PyErr_SetString(state.error, "Malformed AX.25 network address");
         return NULL;
     }
 
-    strcpy(from->ax25_call, temp);
-    call = ax25_ntoa(from);
+    memcpy(from.ax25_call, temp, sizeof(ax25_address));
+    call = ax25_ntoa(&from);
     if (call == NULL) {
-        PyErr_SetString(AX25Error, "Malformed AX.25 network address");
+        PyErr_SetString(state.error, "Malformed AX.25 network address");
         return NULL;
     } else {
-        return Py_BuildValue("s", call);
+        return PyString_FromString(call);
     }
 }
 
 static PyObject *
 py_ax25_socket(PyObject *self, PyObject *args) {
-    int fd, type = SOCK_SEQPACKET, errnum = 0;
+    int fd, type = SOCK_SEQPACKET;
 
     if (!PyArg_ParseTuple(args, "|i", &type)) {
-        PyErr_SetString(AX25Error, "Invalid arguments supplied");
+        PyErr_SetString(state.error, "Invalid arguments supplied");
         return NULL;
     }
 
     if ((fd = socket(AF_AX25, type, 0)) == -1) {
-        errnum = errno;
-        PyErr_SetString(AX25Error, strerror(errnum));
-        return NULL;
+        return PyErr_SetFromErrno(state.error);
     } else {
-        return Py_BuildValue("i", fd);
+        return PyInt_FromLong(fd);
     }
 }
 
 static PyObject *
 py_ax25_accept(PyObject *self, PyObject *args) {
-    int fd, newfd, errnum;
-    union {
-        struct full_sockaddr_ax25 ax25;
-        struct sockaddr_rose rose;
-    } sockaddr;
+    int fd, newfd, flags = 0;
+    struct full_sockaddr_ax25 sockaddr;
     socklen_t addrlen;
 
-    if (!PyArg_ParseTuple(args, "i", &fd)) {
-        PyErr_SetString(AX25Error, "File descriptor argument required");
+    if (!PyArg_ParseTuple(args, "i|i", &fd, &flags)) {
+        PyErr_SetString(state.error, "File descriptor argument required");
         return NULL;
     }
 
     addrlen = sizeof(struct full_sockaddr_ax25);
-    if ((newfd = accept(fd, (struct sockaddr *) &sockaddr, &addrlen)) == -1) {
-        errnum = errno;
-        PyErr_SetString(AX25Error, strerror(errnum));
-        return NULL;
+    Py_BEGIN_ALLOW_THREADS
+    newfd = accept4(fd, (struct sockaddr *) &sockaddr, &addrlen, flags);
+    Py_END_ALLOW_THREADS
+    if (newfd == -1) {
+        return PyErr_SetFromErrno(state.error);
     } else {
-        return Py_BuildValue("si", sockaddr.ax25.fsa_ax25.sax25_call.ax25_call, newfd);
+        return Py_BuildValue("s#i", sockaddr.fsa_ax25.sax25_call.ax25_call,
+            (int) sizeof(ax25_address), newfd);
     }
 }
 
 static PyObject *
 py_ax25_bind(PyObject *self, PyObject *args) {
-    int fd, len, errnum;
+    int fd, len, result;
     const char *call;
     struct full_sockaddr_ax25 src;
 
     if (!PyArg_ParseTuple(args, "is", &fd, &call)) {
-        PyErr_SetString(AX25Error, "Both file descriptor and call sign argument required");
+        PyErr_SetString(state.error, "Both file descriptor and call sign argument required");
         return NULL;
     }
 
     if ((len = ax25_aton(call, &src)) == -1) {
-        PyErr_SetString(AX25Error, "Unable to convert callsign");
+        PyErr_SetString(state.error, "Unable to convert callsign");
         return NULL;
     }
 
-    if (bind(fd, (struct sockaddr *) &src, len) == -1) {
-        errnum = errno;
-        PyErr_SetString(AX25Error, strerror(errnum));
-        return NULL;
+    Py_BEGIN_ALLOW_THREADS
+    result = bind(fd, (struct sockaddr *) &src, len);
+    Py_END_ALLOW_THREADS
+    if (result == -1) {
+        return PyErr_SetFromErrno(state.error);
     } else {
-        return Py_None;
-    }    
+        Py_RETURN_NONE;
+    }
 }
 
 static PyObject *
 py_ax25_recvfrom(PyObject *self, PyObject *args) {
-    return NULL;
+    int fd, len, flags = 0;
+    ssize_t n;
+    struct full_sockaddr_ax25 src;
+    socklen_t addrlen;
+    PyObject *buf;
+
+    if (!PyArg_ParseTuple(args, "ii|i", &fd, &len, &flags)) {
+        PyErr_SetString(state.error, "File descriptor and length argument required");
+        return NULL;
+    }
+
+    if (len < 0) {
+        PyErr_SetString(PyExc_ValueError, "negative buffersize");
+        return NULL;
+    }
+
+    if ((buf = PyString_FromStringAndSize((char *) 0, len)) == NULL) {
+        return NULL;
+    }
+
+    memset(&src, 0, sizeof(src));
+    addrlen = sizeof(struct full_sockaddr_ax25);
+    Py_BEGIN_ALLOW_THREADS
+    n = recvfrom(fd, PyString_AS_STRING(buf), len, flags,
+        (struct sockaddr *) &src, &addrlen);
+    Py_END_ALLOW_THREADS
+    if (n == -1) {
+        Py_DECREF(buf);
+        return PyErr_SetFromErrno(state.error);
+    }
+
+    if (n != len && _PyString_Resize(&buf, n) == -1) {
+        return NULL;
+    }
+
+    return Py_BuildValue("Ns#", buf, src.fsa_ax25.sax25_call.ax25_call,
+        (int) sizeof(ax25_address));
 }
 
 static PyObject *
 py_ax25_sendto(PyObject *self, PyObject *args) {
-    int fd, flags, errnum;
-    size_t len, sent;
+    int fd, buflen, len, flags, addrlen;
+    ssize_t sent;
     const char *buf, *addr;
-    struct full_sockaddr_ax25 *dest = (struct full_sockaddr_ax25 *) malloc(sizeof(struct full_sockaddr_ax25));
-    socklen_t addrlen;
+    struct full_sockaddr_ax25 dest;
 
-    if (!PyArg_ParseTuple(args, "isiis", &fd, &buf, &len, &flags, &addr)) {
-        PyErr_SetString(AX25Error, "Not all arguments supplied");
+    if (!PyArg_ParseTuple(args, "is#iis", &fd, &buf, &buflen, &len, &flags, &addr)) {
+        PyErr_SetString(state.error, "Not all arguments supplied");
         return NULL;
     }
 
+    if (len < 0 || len > buflen) {
+        len = buflen;
+    }
+
     if (flags < 0) {
         flags = 0;
     }
-    
-    if (ax25_aton(addr, dest) == -1) {
-        PyErr_SetString(AX25Error, "Malformed AX.25 call sign");
+
+    if ((addrlen = ax25_aton(addr, &dest)) == -1) {
+        PyErr_SetString(state.error, "Malformed AX.25 call sign");
         return NULL;
     }
 
-    addrlen = sizeof(struct full_sockaddr_ax25);
-    if ((sent = sendto(fd, buf, len, flags, (struct sockaddr *) &dest, addrlen)) == -1) {
-        errnum = errno;
-        PyErr_SetString(AX25Error, strerror(errnum));
-        return NULL;
+    Py_BEGIN_ALLOW_THREADS
+    sent = sendto(fd, buf, len, flags, (struct sockaddr *) &dest, addrlen);
+    Py_END_ALLOW_THREADS
+    if (sent == -1) {
+        return PyErr_SetFromErrno(state.error);
     } else {
-        return Py_BuildValue("i", sent);
-    } 
+        return PyInt_FromSsize_t(sent);
+    }
 }
 
 static PyObject *
-py_ax25_validate(PyObject *self, PyObject *args) {
-    int valid;
+py_ax25_validate(PyObject *self, PyObject *arg) {
     const char *call;
 
-    if (!PyArg_ParseTuple(args, "s", &call)) {
-        PyErr_SetString(AX25Error, "Network address argument required");
+    if ((call = string_arg(arg)) == NULL) {
+        PyErr_SetString(state.error, "Network address argument required");
         return NULL;
     }
 
-    valid = ax25_validate(call);
-    if (valid == TRUE) {
-        return Py_True;
-    } else {
-        return Py_False;
-    }
+    return PyBool_FromLong(ax25_validate(call) == TRUE);
 }
 
 static PyMethodDef _ax25_methods[] = {
-    {"null_address", py_ax25_null_address, 0,            NULL},
-    {"aton",         py_ax25_aton,         METH_VARARGS, aton__doc__},
-    {"ntoa",         py_ax25_ntoa,         METH_VARARGS, ntoa__doc__},
-    {"socket",       py_ax25_socket,       0,            socket__doc__},
+    {"null_address", py_ax25_null_address, METH_NOARGS,  null_address__doc__},
+    {"aton",         py_ax25_aton,         METH_O,       aton__doc__},
+    {"ntoa",         py_ax25_ntoa,         METH_O,       ntoa__doc__},
+    {"socket",       py_ax25_socket,       METH_VARARGS, socket__doc__},
     {"accept",       py_ax25_accept,       METH_VARARGS, accept__doc__},
     {"bind",         py_ax25_bind,         METH_VARARGS, bind__doc__},
     {"recvfrom",     py_ax25_recvfrom,     METH_VARARGS, recvfrom__doc__},
     {"sendto",       py_ax25_sendto,       METH_VARARGS, sendto__doc__},
-    {"validate",     py_ax25_validate,     METH_VARARGS, validate__doc__},
+    {"validate",     py_ax25_validate,     METH_O,       validate__doc__},
     {NULL, NULL} /* sentinel */
 };
 
@@ -213,9 +268,9 @@ init_ax25(void) {
     if (m == NULL)
         return;
 
-    AX25Error = PyErr_NewException("_ax25.error", NULL, NULL);
-    Py_INCREF(AX25Error);
-    PyModule_AddObject(m, "error", AX25Error);
+    state.error = PyErr_NewException("_ax25.error", PyExc_IOError, NULL);
+    Py_INCREF(state.error);
+    PyModule_AddObject(m, "error", state.error);
 
     _FAMILY = Py_BuildValue("i", AF_AX25);
     _TYPE   = Py_BuildValue("i", SOCK_SEQPACKET);
@@ -1,74 +1,155 @@
 #include <Python.h>
 
 #include <errno.h>
+#include <limits.h>
 #include <string.h>
+#include <sys/ioctl.h>
 #include <sys/socket.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 
-#include <netax25/axlib.h>
+// Read size when the kernel has nothing queued for us yet
+#ifndef DEFAULT_BLOCKSIZE
+#define DEFAULT_BLOCKSIZE 4096
+#endif
+
+// Upper bound for reads sized by FIONREAD
+#ifndef MAX_BLOCKSIZE
+#define MAX_BLOCKSIZE 262144
+#endif
+
+// Most buffers written by one sendmsg
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
 
-/* The module exception */
-static PyObject *BareError;
+// Most descriptors passed in one message
+#ifndef MAX_FDS
+#define MAX_FDS 64
+#endif
+
+// Busy polling socket options, older libc headers lack them
+#ifndef SO_BUSY_POLL
+#define SO_BUSY_POLL 46
+#endif
+#ifndef SO_PREFER_BUSY_POLL
+#define SO_PREFER_BUSY_POLL 69
+#endif
 
 /* The module doc string */
 PyDoc_STRVAR(_bare__doc__, "AX.25 protocol functions.");
 
 /* The function doc string */
 PyDoc_STRVAR(socket__doc__,   "socket([domain [type [protocol]]]) -> socket\n\nCreate a socket.");
-PyDoc_STRVAR(accept__doc__,   "accept(fd) -> (conn, address)\n\nAccept a connection.");
+PyDoc_STRVAR(accept__doc__,   "accept(fd) -> (conn, address)\n\nAccept a connection, address is the raw sockaddr of the peer.");
 PyDoc_STRVAR(listen__doc__,   "listen(fd, backlog)\n\nMark the socket on fd as passive socket.");
-PyDoc_STRVAR(recv__doc__,     "recv(fd, len, flags)\n\nReceive message from another socket.");
-PyDoc_STRVAR(send__doc__,     "send(fd, buf, len, flags)\n\nTransmit message to another socket.");
+PyDoc_STRVAR(recv__doc__,     "recv(fd[, len[, flags]])\n\nReceive message from another socket, a len of 0 reads what is waiting.");
+PyDoc_STRVAR(recv_into__doc__, "recv_into(fd, buffer[, len[, flags]]) -> size\n\nReceive message from another socket into a writable buffer.");
+PyDoc_STRVAR(send__doc__,     "send(fd, buf[, len[, flags]]) -> size\n\nTransmit message to another socket.");
+PyDoc_STRVAR(sendmsg__doc__,  "sendmsg(fd, buffers[, flags]) -> size\n\nTransmit a sequence of buffers to another socket in one gathered write.");
+PyDoc_STRVAR(send_fds__doc__, "send_fds(fd, data, fds[, flags]) -> size\n\nTransmit data with a list of file descriptors over an AF_UNIX socket\n(SCM_RIGHTS).");
+PyDoc_STRVAR(recv_fds__doc__, "recv_fds(fd, len, maxfds[, flags]) -> (data, fds)\n\nReceive data and up to maxfds file descriptors from an AF_UNIX socket, the\ndescriptors are close-on-exec. A message that did not fit raises EMSGSIZE.");
+PyDoc_STRVAR(busy_poll__doc__, "busy_poll(fd, usecs[, prefer])\n\nBusy poll the device queue for up to usecs on blocking reads (SO_BUSY_POLL),\nprefer means busy polling over interrupts under load (SO_PREFER_BUSY_POLL).");
+PyDoc_STRVAR(stats__doc__,    "stats() -> dict\n\nSystem call and byte counters of this module.");
+
+/* Module state: the exception, cached objects and the always-on counters */
+static struct {
+    PyObject *error;
+    PyObject *keys[5];
+    unsigned long long recv_calls;
+    unsigned long long recv_bytes;
+    unsigned long long send_calls;
+    unsigned long long send_bytes;
+    unsigned long long errors;
+} state;
+
+static const char *stats_keys[5] = {
+    "recv_calls", "recv_bytes", "send_calls", "send_bytes", "errors"
+};
+
+/* Argument unpacking for the hot paths, skips the format string parsing */
+
+static inline int
+int_arg(PyObject *args, Py_ssize_t i, int *value) {
+    PyObject *item = PyTuple_GET_ITEM(args, i);
+    long result;
+
+    if (PyInt_CheckExact(item)) {
+        result = PyInt_AS_LONG(item);
+    } else if ((result = PyInt_AsLong(item)) == -1 && PyErr_Occurred()) {
+        return -1;
+    }
+    if (result < INT_MIN || result > INT_MAX) {
+        PyErr_SetString(PyExc_OverflowError, "signed integer is out of range");
+        return -1;
+    }
+    *value = (int) result;
+    return 0;
+}
+
+static int
+int_args(PyObject *args, Py_ssize_t start, Py_ssize_t required, int *values) {
+    Py_ssize_t i, size = PyTuple_GET_SIZE(args);
+
+    if (size < required) {
+        return -1;
+    }
+    for (i = start; i < size; ++i) {
+        if (int_arg(args, i, &values[i - start]) == -1) {
+            return -1;
+        }
+    }
+    return 0;
+}
 
 /* The wrapper to the underlying C functions */
 
 static PyObject *
 py_bare_socket(PyObject *self, PyObject *args) {
-    int fd, domain = AF_INET, type = SOCK_STREAM, proto = 0, errnum = 0;
+    int fd, domain = AF_INET, type = SOCK_STREAM, proto = 0;
 
     if (!PyArg_ParseTuple(args, "|iii", &domain, &type, &proto)) {
-        PyErr_SetString(BareError, "Invalid arguments supplied");
+        PyErr_SetString(state.error, "Invalid arguments supplied");
         return NULL;
     }
 
-    if ((fd = socket(domain, type, 0)) == -1) {
-        errnum = errno;
-        PyErr_SetString(PyExc_IOError, strerror(errnum));
-        return NULL;
+    if ((fd = socket(domain, type, proto)) == -1) {
+        return PyErr_SetFromErrno(PyExc_IOError);
     } else {
-        return Py_BuildValue("i", fd);
+        return PyInt_FromLong(fd);
     }
 }
 
 static PyObject *
 py_bare_accept(PyObject *self, PyObject *args) {
-    int fd, newfd, errnum;
-    struct sockaddr *addr;
+    int fd, newfd;
+    struct sockaddr_storage addr;
     socklen_t addrlen;
 
     if (!PyArg_ParseTuple(args, "i", &fd)) {
-        PyErr_SetString(BareError, "File descriptor argument required");
+        PyErr_SetString(state.error, "File descriptor argument required");
         return NULL;
     }
 
-    addrlen = sizeof(struct sockaddr);
+    addrlen = sizeof(addr);
     if ((newfd = accept(fd, (struct sockaddr *) &addr, &addrlen)) == -1) {
-        errnum = errno;
-        PyErr_SetString(PyExc_IOError, strerror(errnum));
-        return NULL;
+        return PyErr_SetFromErrno(PyExc_IOError);
     } else {
-        return Py_BuildValue("si", addr->sa_data, newfd);
+        // The kernel may report a longer address than fits
+        if (addrlen > sizeof(addr)) {
+            addrlen = sizeof(addr);
+        }
+        return Py_BuildValue("is#", newfd, (char *) &addr, (int) addrlen);
     }
 }
 
 static PyObject *
 py_bare_listen(PyObject *self, PyObject *args) {
-    int fd, backlog;
-    int errnum = 0;
+    int fd, backlog = 0;
 
     if (!PyArg_ParseTuple(args, "i|i", &fd, &backlog)) {
-        PyErr_SetString(BareError, "File descriptor argument required");
+        PyErr_SetString(state.error, "File descriptor argument required");
         return NULL;
     }
 
@@ -77,35 +158,39 @@ py_bare_listen(PyObject *self, PyObject *args) {
     }
 
     if (listen(fd, backlog) == -1) {
-        errnum = errno;
-        PyErr_SetString(PyExc_IOError, strerror(errnum));
-        return NULL;
+        return PyErr_SetFromErrno(PyExc_IOError);
     } else {
-        return Py_None;
+        Py_RETURN_NONE;
     }
 }
 
 static PyObject *
 py_bare_recv(PyObject *self, PyObject *args) {
-    int fd, flags, n, len, errnum;
+    // fd, len, flags
+    int values[3] = {-1, 0, 0}, n, len;
     PyObject *buf;
 
-    if (!PyArg_ParseTuple(args, "i|ii", &fd, &len, &flags)) {
-        PyErr_SetString(BareError, "Not all arguments supplied");
+    if (PyTuple_GET_SIZE(args) > 3 || int_args(args, 0, 1, values) == -1) {
+        // Keep the TypeError or OverflowError of a bad argument
+        if (!PyErr_Occurred()) {
+            PyErr_SetString(state.error, "Not all arguments supplied");
+        }
         return NULL;
     }
 
-    if (len < 0) {
+    if ((len = values[1]) < 0) {
         PyErr_SetString(PyExc_ValueError, "negative buffersize");
         return NULL;
     }
 
-    if (len == 0) {
-        len = 4096;
+    // Size the read after what the kernel has waiting for us
+    if (len == 0 && ioctl(values[0], FIONREAD, &len) == -1) {
+        len = 0;
     }
-
-    if (!flags) {
-        flags = 0;
+    if (len == 0) {
+        len = DEFAULT_BLOCKSIZE;
+    } else if (len > MAX_BLOCKSIZE) {
+        len = MAX_BLOCKSIZE;
     }
 
     buf = PyString_FromStringAndSize((char *) 0, len);
@@ -113,12 +198,16 @@ py_bare_recv(PyObject *self, PyObject *args) {
         return NULL;
     }
 
-    if ((n = recv(fd, PyString_AS_STRING(buf), len, flags)) == -1) {
-        errnum = errno;
-        PyErr_SetString(PyExc_IOError, strerror(errnum));
+    state.recv_calls++;
+    Py_BEGIN_ALLOW_THREADS
+    n = recv(values[0], PyString_AS_STRING(buf), len, values[2]);
+    Py_END_ALLOW_THREADS
+    if (n == -1) {
+        state.errors++;
         Py_DECREF(buf);
-        return NULL;
+        return PyErr_SetFromErrno(PyExc_IOError);
     }
+    state.recv_bytes += n;
 
     if (n != len) {
         _PyString_Resize(&buf, n);
@@ -127,36 +216,381 @@ py_bare_recv(PyObject *self, PyObject *args) {
     return buf;
 }
 
+static PyObject *
+py_bare_recv_into(PyObject *self, PyObject *args) {
+    // fd, len, flags around the buffer
+    int fd, values[2] = {0, 0}, len;
+    ssize_t n;
+    Py_buffer buf;
+    Py_ssize_t size = PyTuple_GET_SIZE(args);
+
+    if (size < 2 || size > 4 || int_arg(args, 0, &fd) == -1
+        || int_args(args, 2, 2, values) == -1) {
+        if (!PyErr_Occurred()) {
+            PyErr_SetString(state.error, "Not all arguments supplied");
+        }
+        return NULL;
+    }
+
+    if (PyObject_GetBuffer(PyTuple_GET_ITEM(args, 1), &buf,
+        PyBUF_WRITABLE) == -1) {
+        PyErr_SetString(state.error, "Writable buffer argument required");
+        return NULL;
+    }
+
+    if ((len = values[0]) < 0) {
+        PyBuffer_Release(&buf);
+        PyErr_SetString(PyExc_ValueError, "negative buffersize");
+        return NULL;
+    }
+
+    if (len == 0 || len > buf.len) {
+        len = buf.len;
+    }
+
+    state.recv_calls++;
+    Py_BEGIN_ALLOW_THREADS
+    n = recv(fd, buf.buf, len, values[1]);
+    Py_END_ALLOW_THREADS
+    PyBuffer_Release(&buf);
+    if (n == -1) {
+        state.errors++;
+        return PyErr_SetFromErrno(PyExc_IOError);
+    }
+    state.recv_bytes += n;
+
+    return PyInt_FromSsize_t(n);
+}
+
 static PyObject *
 py_bare_send(PyObject *self, PyObject *args) {
-    int fd, flags, errnum;
-    size_t len, sent;
+    // fd, len, flags around the buffer
+    int fd, values[2] = {-1, 0}, buflen, len, flags;
+    ssize_t sent;
     const char *buf;
+    PyObject *data;
+    Py_ssize_t size = PyTuple_GET_SIZE(args);
 
-    if (!PyArg_ParseTuple(args, "isi|i", &fd, &buf, &len, &flags)) {
-        PyErr_SetString(BareError, "Not all arguments supplied");
+    if (size < 2 || size > 4 || int_arg(args, 0, &fd) == -1
+        || int_args(args, 2, 2, values) == -1) {
+        if (!PyErr_Occurred()) {
+            PyErr_SetString(state.error, "Not all arguments supplied");
+        }
         return NULL;
     }
 
-    if (flags < 0) {
+    // Strings are what we get nearly always, anything else goes through the
+    // same conversion as "s#"
+    data = PyTuple_GET_ITEM(args, 1);
+    if (PyString_CheckExact(data)) {
+        buf = PyString_AS_STRING(data);
+        buflen = (int) PyString_GET_SIZE(data);
+    } else if (!PyArg_ParseTuple(args, "is#|ii", &fd, &buf, &buflen,
+        &values[0], &values[1])) {
+        PyErr_SetString(state.error, "Not all arguments supplied");
+        return NULL;
+    }
+
+    if ((len = values[0]) < 0 || len > buflen) {
+        len = buflen;
+    }
+
+    if ((flags = values[1]) < 0) {
         flags = 0;
     }
 
-    if ((sent = send(fd, buf, len, flags)) == -1) {
-        errnum = errno;
-        PyErr_SetString(PyExc_IOError, strerror(errnum));
-        return NULL;
+    state.send_calls++;
+    Py_BEGIN_ALLOW_THREADS
+    sent = send(fd, buf, len, flags);
+    Py_END_ALLOW_THREADS
+    if (sent == -1) {
+        state.errors++;
+        return PyErr_SetFromErrno(PyExc_IOError);
     } else {
-        return Py_BuildValue("i", sent);
-    } 
+        state.send_bytes += sent;
+        return PyInt_FromSsize_t(sent);
+    }
+}
+
+static PyObject *
+py_bare_sendmsg(PyObject *self, PyObject *args) {
+    int fd, flags = 0;
+    ssize_t sent;
+    Py_ssize_t i, count, len;
+    PyObject *buffers, *items, *item;
+    struct iovec iov[IOV_MAX];
+    struct msghdr msg;
+
+    if (!PyArg_ParseTuple(args, "iO|i", &fd, &buffers, &flags)) {
+        PyErr_SetString(state.error, "File descriptor and buffers required");
+        return NULL;
+    }
+
+    // Our own copy of at most IOV_MAX items keeps them alive while we write
+    // without the GIL, the rest goes out with the next call
+    if ((items = PySequence_GetSlice(buffers, 0, IOV_MAX)) == NULL) {
+        return NULL;
+    }
+    if (!PyList_Check(items) && !PyTuple_Check(items)) {
+        Py_DECREF(items);
+        PyErr_SetString(PyExc_TypeError, "buffers must be a list or tuple");
+        return NULL;
+    }
+
+    count = PySequence_Fast_GET_SIZE(items);
+    for (i = 0; i < count; ++i) {
+        item = PySequence_Fast_GET_ITEM(items, i);
+        if (PyString_CheckExact(item)) {
+            iov[i].iov_base = PyString_AS_STRING(item);
+            iov[i].iov_len = PyString_GET_SIZE(item);
+        } else if (PyObject_AsReadBuffer(item, (const void **) &iov[i].iov_base,
+            &len) == 0) {
+            iov[i].iov_len = len;
+        } else {
+            Py_DECREF(items);
+            return NULL;
+        }
+    }
+
+    memset(&msg, 0, sizeof(struct msghdr));
+    msg.msg_iov = iov;
+    msg.msg_iovlen = count;
+
+    state.send_calls++;
+    Py_BEGIN_ALLOW_THREADS
+    sent = sendmsg(fd, &msg, flags);
+    Py_END_ALLOW_THREADS
+    Py_DECREF(items);
+    if (sent == -1) {
+        state.errors++;
+        return PyErr_SetFromErrno(PyExc_IOError);
+    }
+    state.send_bytes += sent;
+    return PyInt_FromSsize_t(sent);
+}
+
+static PyObject *
+py_bare_send_fds(PyObject *self, PyObject *args) {
+    int fd, flags = 0, fds[MAX_FDS];
+    ssize_t sent;
+    const char *buf;
+    Py_ssize_t i, count;
+    int buflen;
+    PyObject *list, *item;
+    struct iovec iov;
+    struct msghdr msg;
+    struct cmsghdr *cmsg;
+    char control[CMSG_SPACE(sizeof(fds))];
+
+    if (!PyArg_ParseTuple(args, "is#O|i", &fd, &buf, &buflen, &list, &flags)) {
+        PyErr_SetString(state.error, "File descriptor, data and fds required");
+        return NULL;
+    }
+    if (!PyList_Check(list) && !PyTuple_Check(list)) {
+        PyErr_SetString(PyExc_TypeError, "fds must be a list or tuple");
+        return NULL;
+    }
+    if ((count = PySequence_Fast_GET_SIZE(list)) > MAX_FDS) {
+        PyErr_Format(PyExc_ValueError, "at most %d fds per message", MAX_FDS);
+        return NULL;
+    }
+    for (i = 0; i < count; ++i) {
+        item = PySequence_Fast_GET_ITEM(list, i);
+        if ((fds[i] = (int) PyInt_AsLong(item)) == -1 && PyErr_Occurred()) {
+            return NULL;
+        }
+    }
+
+    // Without any bytes the descriptors could not be told from end of file
+    if (buflen == 0) {
+        PyErr_SetString(PyExc_ValueError, "data must not be empty");
+        return NULL;
+    }
+    iov.iov_base = (void *) buf;
+    iov.iov_len = buflen;
+    memset(&msg, 0, sizeof(struct msghdr));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    if (count) {
+        memset(control, 0, sizeof(control));
+        msg.msg_control = control;
+        msg.msg_controllen = CMSG_SPACE(count * sizeof(int));
+        cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(count * sizeof(int));
+        memcpy(CMSG_DATA(cmsg), fds, count * sizeof(int));
+    }
+
+    state.send_calls++;
+    Py_BEGIN_ALLOW_THREADS
+    sent = sendmsg(fd, &msg, flags);
+    Py_END_ALLOW_THREADS
+    if (sent == -1) {
+        state.errors++;
+        return PyErr_SetFromErrno(PyExc_IOError);
+    }
+    state.send_bytes += sent;
+    return PyInt_FromSsize_t(sent);
+}
+
+static PyObject *
+py_bare_recv_fds(PyObject *self, PyObject *args) {
+    int fd, len, maxfds, flags = 0, received[MAX_FDS];
+    ssize_t n;
+    Py_ssize_t i, size, count = 0;
+    PyObject *data, *fds, *item, *result;
+    struct iovec iov;
+    struct msghdr msg;
+    struct cmsghdr *cmsg;
+    char control[CMSG_SPACE(MAX_FDS * sizeof(int))];
+
+    if (!PyArg_ParseTuple(args, "iii|i", &fd, &len, &maxfds, &flags)) {
+        PyErr_SetString(state.error, "File descriptor, len and maxfds required");
+        return NULL;
+    }
+    if (len <= 0) {
+        len = DEFAULT_BLOCKSIZE;
+    }
+    if (maxfds < 0 || maxfds > MAX_FDS) {
+        maxfds = MAX_FDS;
+    }
+    if ((data = PyString_FromStringAndSize(NULL, len)) == NULL) {
+        return NULL;
+    }
+
+    iov.iov_base = PyString_AS_STRING(data);
+    iov.iov_len = len;
+    memset(&msg, 0, sizeof(struct msghdr));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    if (maxfds) {
+        msg.msg_control = control;
+        msg.msg_controllen = CMSG_SPACE(maxfds * sizeof(int));
+    }
+
+    state.recv_calls++;
+    Py_BEGIN_ALLOW_THREADS
+    n = recvmsg(fd, &msg, flags | MSG_CMSG_CLOEXEC);
+    Py_END_ALLOW_THREADS
+    if (n == -1) {
+        state.errors++;
+        Py_DECREF(data);
+        return PyErr_SetFromErrno(PyExc_IOError);
+    }
+    state.recv_bytes += n;
+
+    for (cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL;
+        cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+            size = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            if (count + size > MAX_FDS) {
+                size = MAX_FDS - count;
+            }
+            memcpy(&received[count], CMSG_DATA(cmsg), size * sizeof(int));
+            count += size;
+        }
+    }
+
+    // Whatever was cut off is lost, do not pass the rest off as complete
+    if (msg.msg_flags & (MSG_TRUNC | MSG_CTRUNC)) {
+        state.errors++;
+        if ((item = Py_BuildValue("(is)", EMSGSIZE,
+                msg.msg_flags & MSG_CTRUNC ? "Control data truncated"
+                    : "Message truncated")) != NULL) {
+            PyErr_SetObject(PyExc_IOError, item);
+            Py_DECREF(item);
+        }
+        goto error;
+    }
+
+    // From here on the descriptors are ours, close them if we cannot hand
+    // them out
+    if ((fds = PyList_New(count)) == NULL) {
+        goto error;
+    }
+    for (i = 0; i < count; ++i) {
+        if ((item = PyInt_FromLong(received[i])) == NULL) {
+            Py_DECREF(fds);
+            goto error;
+        }
+        PyList_SET_ITEM(fds, i, item);
+    }
+
+    if (n != len && _PyString_Resize(&data, n) == -1) {
+        Py_DECREF(fds);
+        goto error;
+    }
+    result = PyTuple_Pack(2, data, fds);
+    Py_DECREF(data);
+    Py_DECREF(fds);
+    return result;
+
+error:
+    for (i = 0; i < count; ++i) {
+        close(received[i]);
+    }
+    Py_XDECREF(data);
+    return NULL;
+}
+
+static PyObject *
+py_bare_busy_poll(PyObject *self, PyObject *args) {
+    int fd, usecs, prefer = 0;
+
+    if (!PyArg_ParseTuple(args, "ii|i", &fd, &usecs, &prefer)) {
+        PyErr_SetString(state.error, "File descriptor and usecs required");
+        return NULL;
+    }
+
+    // Raising the busy poll time needs CAP_NET_ADMIN
+    if (setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL, &usecs, sizeof(usecs)) == -1) {
+        return PyErr_SetFromErrno(PyExc_IOError);
+    }
+    // Only available since Linux 5.11, only try when asked for
+    if (prefer && setsockopt(fd, SOL_SOCKET, SO_PREFER_BUSY_POLL, &prefer,
+        sizeof(prefer)) == -1) {
+        return PyErr_SetFromErrno(PyExc_IOError);
+    }
+    Py_RETURN_NONE;
+}
+
+static PyObject *
+py_bare_stats(PyObject *self, PyObject *unused) {
+    unsigned long long values[5] = {
+        state.recv_calls, state.recv_bytes, state.send_calls,
+        state.send_bytes, state.errors
+    };
+    PyObject *result, *value;
+    int i;
+
+    if ((result = PyDict_New()) == NULL) {
+        return NULL;
+    }
+    for (i = 0; i < 5; ++i) {
+        if ((value = PyLong_FromUnsignedLongLong(values[i])) == NULL
+            || PyDict_SetItem(result, state.keys[i], value) == -1) {
+            Py_XDECREF(value);
+            Py_DECREF(result);
+            return NULL;
+        }
+        Py_DECREF(value);
+    }
+    return result;
 }
 
 static PyMethodDef _bare_methods[] = {
-    {"socket", py_bare_socket, 0,            socket__doc__},
-    {"accept", py_bare_accept, METH_VARARGS, accept__doc__},
-    {"listen", py_bare_listen, METH_VARARGS, listen__doc__},
-    {"recv",   py_bare_recv,   METH_VARARGS, recv__doc__},
-    {"send",   py_bare_send,   METH_VARARGS, send__doc__},
+    {"socket",    py_bare_socket,    METH_VARARGS, socket__doc__},
+    {"accept",    py_bare_accept,    METH_VARARGS, accept__doc__},
+    {"listen",    py_bare_listen,    METH_VARARGS, listen__doc__},
+    {"recv",      py_bare_recv,      METH_VARARGS, recv__doc__},
+    {"recv_into", py_bare_recv_into, METH_VARARGS, recv_into__doc__},
+    {"send",      py_bare_send,      METH_VARARGS, send__doc__},
+    {"sendmsg",   py_bare_sendmsg,   METH_VARARGS, sendmsg__doc__},
+    {"send_fds",  py_bare_send_fds,  METH_VARARGS, send_fds__doc__},
+    {"recv_fds",  py_bare_recv_fds,  METH_VARARGS, recv_fds__doc__},
+    {"busy_poll", py_bare_busy_poll, METH_VARARGS, busy_poll__doc__},
+    {"stats",     py_bare_stats,     METH_NOARGS,  stats__doc__},
     {NULL, NULL} /* sentinel */
 };
 
@@ -437,15 +871,21 @@ init_bare(void) {
         *_AF_MAX          = Py_BuildValue("i", AF_MAX),
 #endif
         *m;
+    int i;
 
     m = Py_InitModule3("_bare", _bare_methods,
         _bare__doc__);
     if (m == NULL)
         return;
 
-    BareError = PyErr_NewException("_bare.error", NULL, NULL);
-    Py_INCREF(BareError);
-    PyModule_AddObject(m, "error", BareError);
+    for (i = 0; i < 5; ++i) {
+        if ((state.keys[i] = PyString_InternFromString(stats_keys[i])) == NULL)
+            return;
+    }
+
+    state.error = PyErr_NewException("_bare.error", NULL, NULL);
+    Py_INCREF(state.error);
+    PyModule_AddObject(m, "error", state.error);
 
 #ifdef SOCK_STREAM
     PyModule_AddObject(m, "SOCK_STREAM", _SOCK_STREAM);
@@ -0,0 +1,837 @@
+#include <Python.h>
+#include <structmember.h>
+
+#include <stdint.h>
+#include <string.h>
+
+/*
+ * AX.25 frame decoding and encoding, without going through libax25.
+ *
+ * A Decoder turns a batch of raw frames into an array of fixed size records,
+ * readable through the buffer protocol, with call signs replaced by ids into
+ * the call sign table of the decoder. Every call sign is formatted once, after
+ * that finding it costs a hash lookup on the raw address bytes.
+ */
+#define MAX_DIGIS     8
+#define ADDRESS_SIZE  7
+#define MIN_FRAME     (2 * ADDRESS_SIZE + 1)
+
+// Bits in the last byte of an address field
+#define ADDRESS_LAST  0x01
+#define ADDRESS_SSID  0x1e
+#define ADDRESS_SPARE 0x60
+#define ADDRESS_CH    0x80
+
+// Record flags
+#define RECORD_DEST_C 0x01
+#define RECORD_SRC_C  0x02
+#define RECORD_PID    0x04
+
+// Call signs we remember before the encoder starts over
+#ifndef ENCODE_CACHE_SIZE
+#define ENCODE_CACHE_SIZE 4096
+#endif
+
+typedef struct {
+    uint32_t frame;
+    uint32_t dest;
+    uint32_t src;
+    uint32_t digis[MAX_DIGIS];
+    uint32_t info_offset;
+    uint32_t info_length;
+    uint8_t ndigis;
+    uint8_t repeated;
+    uint8_t control;
+    uint8_t pid;
+    uint8_t flags;
+    uint8_t pad[3];
+} ax25_record;
+
+/* struct module format of ax25_record */
+static char record_format[] = "=III8IIIBBBBB3x";
+
+/* The module doc string */
+PyDoc_STRVAR(_frame__doc__, "AX.25 frame decoding and encoding.");
+
+/* The function doc string */
+PyDoc_STRVAR(encode__doc__,   "encode(dest, src[, digis[, control[, pid[, info[, command]]]]]) -> frame\n\nBuild a frame, digipeaters that have repeated it carry a trailing '*'.");
+PyDoc_STRVAR(Decoder__doc__,  "Decoder()\n\nBatch frame decoder with a call sign table.");
+PyDoc_STRVAR(decode__doc__,   "decode(frames) -> Records\n\nDecode a sequence of raw frames, invalid frames are skipped.");
+PyDoc_STRVAR(callsign__doc__, "callsign(id) -> call\n\nCall sign in the table of this decoder.");
+PyDoc_STRVAR(clear__doc__,    "clear()\n\nForget all call signs, records decoded before keep theirs.");
+PyDoc_STRVAR(frame__doc__,    "frame(i) -> index\n\nIndex of the frame record i was decoded from.");
+PyDoc_STRVAR(Records__doc__,  "Decoded frames, as (dest, src, digis, control, pid, info) tuples or as a\nbuffer of records in the format given by the format attribute.");
+
+typedef struct {
+    uint64_t key;
+    uint32_t id;
+} callsign_slot;
+
+typedef struct {
+    PyObject_HEAD
+    callsign_slot *slots;
+    Py_ssize_t capacity;
+    PyObject *names;
+    PyObject *repeated;
+    unsigned long long hits;
+    unsigned long long misses;
+    unsigned long long errors;
+} DecoderObject;
+
+typedef struct {
+    PyObject_HEAD
+    DecoderObject *decoder;
+    PyObject *frames;
+    // The call sign table the ids in records point into
+    PyObject *names;
+    PyObject *repeated;
+    Py_ssize_t count;
+    ax25_record *records;
+} RecordsObject;
+
+static PyTypeObject RecordsType;
+
+/* Call sign and SSID bits of an address field, never 0 */
+static inline uint64_t
+callsign_key(const unsigned char *address) {
+    uint64_t key = 1ULL << 63;
+    int i;
+
+    for (i = 0; i < 6; ++i) {
+        key |= (uint64_t) (address[i] >> 1) << (i * 7 + 4);
+    }
+    return key | ((address[6] & ADDRESS_SSID) >> 1);
+}
+
+static inline Py_ssize_t
+callsign_hash(uint64_t key, Py_ssize_t capacity) {
+    return (Py_ssize_t) ((key * 0x9e3779b97f4a7c15ULL) >> 32) & (capacity - 1);
+}
+
+static PyObject *
+callsign_format(const unsigned char *address) {
+    char call[10];
+    int i, n = 0, ssid = (address[6] & ADDRESS_SSID) >> 1;
+
+    for (i = 0; i < 6; ++i) {
+        call[i] = (address[i] >> 1) & 0x7f;
+        // Call signs are padded with spaces
+        if (call[i] != ' ') {
+            n = i + 1;
+        }
+    }
+    if (ssid) {
+        n += sprintf(call + n, "-%d", ssid);
+    }
+    return PyString_FromStringAndSize(call, n);
+}
+
+static int
+decoder_grow(DecoderObject *self) {
+    callsign_slot *slots, *old = self->slots;
+    Py_ssize_t i, j, capacity = self->capacity ? self->capacity << 1 : 256;
+
+    if ((slots = PyMem_Malloc(capacity * sizeof(callsign_slot))) == NULL) {
+        PyErr_NoMemory();
+        return -1;
+    }
+    memset(slots, 0, capacity * sizeof(callsign_slot));
+    for (i = 0; i < self->capacity; ++i) {
+        if (old[i].key == 0) {
+            continue;
+        }
+        j = callsign_hash(old[i].key, capacity);
+        while (slots[j].key != 0) {
+            j = (j + 1) & (capacity - 1);
+        }
+        slots[j] = old[i];
+    }
+    PyMem_Free(old);
+    self->slots = slots;
+    self->capacity = capacity;
+    return 0;
+}
+
+/* Id of the call sign in address, adding it to the table on first sight */
+static long
+decoder_callsign(DecoderObject *self, const unsigned char *address) {
+    uint64_t key = callsign_key(address);
+    Py_ssize_t i, id;
+    PyObject *name;
+
+    i = callsign_hash(key, self->capacity);
+    while (self->slots[i].key != 0) {
+        if (self->slots[i].key == key) {
+            self->hits++;
+            return self->slots[i].id;
+        }
+        i = (i + 1) & (self->capacity - 1);
+    }
+
+    self->misses++;
+    if ((name = callsign_format(address)) == NULL) {
+        return -1;
+    }
+    PyString_InternInPlace(&name);
+    id = PyList_GET_SIZE(self->names);
+    if (PyList_Append(self->names, name) == -1
+        || PyList_Append(self->repeated, Py_None) == -1) {
+        Py_DECREF(name);
+        return -1;
+    }
+    Py_DECREF(name);
+
+    self->slots[i].key = key;
+    self->slots[i].id = (uint32_t) id;
+    // Keep the table at most half full
+    if ((id + 1) * 2 > self->capacity && decoder_grow(self) == -1) {
+        return -1;
+    }
+    return id;
+}
+
+/* Parse one frame into record, returns 0 when the frame is invalid */
+static int
+decoder_parse(DecoderObject *self, ax25_record *record,
+        const unsigned char *frame, Py_ssize_t size) {
+    const unsigned char *p = frame, *end = frame + size;
+    long id;
+    int i, n = 0;
+
+    if (size < MIN_FRAME) {
+        return 0;
+    }
+
+    memset(record, 0, sizeof(ax25_record));
+    // Destination, source and digipeaters until the address extension bit
+    for (;;) {
+        if (p + ADDRESS_SIZE >= end || n == MAX_DIGIS + 2) {
+            return 0;
+        }
+        n++;
+        p += ADDRESS_SIZE;
+        if (p[-1] & ADDRESS_LAST) {
+            break;
+        }
+    }
+    if (n < 2) {
+        return 0;
+    }
+
+    record->control = *p++;
+    // I and UI frames carry a protocol id
+    if ((record->control & 0x01) == 0 || (record->control & 0xef) == 0x03) {
+        if (p == end) {
+            return 0;
+        }
+        record->pid = *p++;
+        record->flags |= RECORD_PID;
+    }
+    record->info_offset = (uint32_t) (p - frame);
+    record->info_length = (uint32_t) (end - p);
+
+    // Only call signs of frames that are accepted go into the table
+    record->ndigis = n - 2;
+    for (i = 0, p = frame; i < n; ++i, p += ADDRESS_SIZE) {
+        if ((id = decoder_callsign(self, p)) == -1) {
+            return -1;
+        }
+        if (i == 0) {
+            record->dest = (uint32_t) id;
+            if (p[6] & ADDRESS_CH) {
+                record->flags |= RECORD_DEST_C;
+            }
+        } else if (i == 1) {
+            record->src = (uint32_t) id;
+            if (p[6] & ADDRESS_CH) {
+                record->flags |= RECORD_SRC_C;
+            }
+        } else {
+            record->digis[i - 2] = (uint32_t) id;
+            if (p[6] & ADDRESS_CH) {
+                record->repeated |= 1 << (i - 2);
+            }
+        }
+    }
+    return 1;
+}
+
+static PyObject *
+py_decoder_new(PyTypeObject *type, PyObject *args, PyObject *kwargs) {
+    DecoderObject *self;
+
+    if ((self = (DecoderObject *) type->tp_alloc(type, 0)) == NULL) {
+        return NULL;
+    }
+    if ((self->names = PyList_New(0)) == NULL
+        || (self->repeated = PyList_New(0)) == NULL
+        || decoder_grow(self) == -1) {
+        Py_DECREF(self);
+        return NULL;
+    }
+    return (PyObject *) self;
+}
+
+static void
+py_decoder_dealloc(DecoderObject *self) {
+    PyMem_Free(self->slots);
+    Py_XDECREF(self->names);
+    Py_XDECREF(self->repeated);
+    Py_TYPE(self)->tp_free((PyObject *) self);
+}
+
+static PyObject *
+py_decoder_decode(DecoderObject *self, PyObject *frames) {
+    RecordsObject *records;
+    PyObject *seq, *item;
+    Py_ssize_t i, count;
+    int valid;
+
+    if ((seq = PySequence_Fast(frames, "frames must be a sequence")) == NULL) {
+        return NULL;
+    }
+
+    records = PyObject_New(RecordsObject, &RecordsType);
+    if (records == NULL) {
+        Py_DECREF(seq);
+        return NULL;
+    }
+    records->decoder = self;
+    Py_INCREF(self);
+    records->frames = seq;
+    records->names = self->names;
+    Py_INCREF(records->names);
+    records->repeated = self->repeated;
+    Py_INCREF(records->repeated);
+    records->count = 0;
+    count = PySequence_Fast_GET_SIZE(seq);
+    records->records = PyMem_Malloc((count ? count : 1) * sizeof(ax25_record));
+    if (records->records == NULL) {
+        Py_DECREF(records);
+        return PyErr_NoMemory();
+    }
+
+    for (i = 0; i < count; ++i) {
+        item = PySequence_Fast_GET_ITEM(seq, i);
+        if (!PyString_Check(item)) {
+            Py_DECREF(records);
+            PyErr_SetString(PyExc_TypeError, "frames must be strings");
+            return NULL;
+        }
+        valid = decoder_parse(self, &records->records[records->count],
+            (const unsigned char *) PyString_AS_STRING(item),
+            PyString_GET_SIZE(item));
+        if (valid == -1) {
+            Py_DECREF(records);
+            return NULL;
+        } else if (valid) {
+            records->records[records->count++].frame = (uint32_t) i;
+        } else {
+            self->errors++;
+        }
+    }
+    return (PyObject *) records;
+}
+
+static PyObject *
+py_decoder_callsign(DecoderObject *self, PyObject *args) {
+    Py_ssize_t id;
+    PyObject *name;
+
+    if (!PyArg_ParseTuple(args, "n", &id)) {
+        return NULL;
+    }
+    if (id < 0 || id >= PyList_GET_SIZE(self->names)) {
+        PyErr_SetString(PyExc_IndexError, "unknown call sign id");
+        return NULL;
+    }
+    name = PyList_GET_ITEM(self->names, id);
+    Py_INCREF(name);
+    return name;
+}
+
+static PyObject *
+py_decoder_clear(DecoderObject *self, PyObject *unused) {
+    PyObject *names, *repeated;
+
+    // New lists, records decoded before hold on to the old ones
+    if ((names = PyList_New(0)) == NULL) {
+        return NULL;
+    }
+    if ((repeated = PyList_New(0)) == NULL) {
+        Py_DECREF(names);
+        return NULL;
+    }
+    memset(self->slots, 0, self->capacity * sizeof(callsign_slot));
+    Py_DECREF(self->names);
+    self->names = names;
+    Py_DECREF(self->repeated);
+    self->repeated = repeated;
+    Py_RETURN_NONE;
+}
+
+static PyObject *
+py_decoder_callsigns(DecoderObject *self, void *closure) {
+    return PyInt_FromSsize_t(PyList_GET_SIZE(self->names));
+}
+
+/* Call sign of id in the table of records, with the has-been-repeated mark
+ * when asked for, which is formatted once per call sign */
+static PyObject *
+records_callsign(RecordsObject *self, uint32_t id, int repeated) {
+    PyObject *name, *call;
+    Py_ssize_t size;
+
+    if ((Py_ssize_t) id >= PyList_GET_SIZE(self->names)
+        || (Py_ssize_t) id >= PyList_GET_SIZE(self->repeated)) {
+        PyErr_SetString(PyExc_IndexError, "unknown call sign id");
+        return NULL;
+    }
+    call = PyList_GET_ITEM(self->names, id);
+    if (!repeated) {
+        Py_INCREF(call);
+        return call;
+    }
+
+    name = PyList_GET_ITEM(self->repeated, id);
+    if (name == Py_None) {
+        size = PyString_GET_SIZE(call);
+        if ((name = PyString_FromStringAndSize((char *) 0, size + 1)) == NULL) {
+            return NULL;
+        }
+        memcpy(PyString_AS_STRING(name), PyString_AS_STRING(call), size);
+        PyString_AS_STRING(name)[size] = '*';
+        PyString_InternInPlace(&name);
+        PyList_SetItem(self->repeated, id, name);
+    }
+    Py_INCREF(name);
+    return name;
+}
+
+static void
+py_records_dealloc(RecordsObject *self) {
+    PyMem_Free(self->records);
+    Py_XDECREF(self->decoder);
+    Py_XDECREF(self->frames);
+    Py_XDECREF(self->names);
+    Py_XDECREF(self->repeated);
+    PyObject_Del(self);
+}
+
+static Py_ssize_t
+py_records_length(RecordsObject *self) {
+    return self->count;
+}
+
+static PyObject *
+py_records_item(RecordsObject *self, Py_ssize_t i) {
+    ax25_record *record;
+    PyObject *dest, *src, *digis, *name, *frame, *pid;
+    int n;
+
+    if (i < 0 || i >= self->count) {
+        PyErr_SetString(PyExc_IndexError, "record index out of range");
+        return NULL;
+    }
+    record = &self->records[i];
+
+    if ((digis = PyTuple_New(record->ndigis)) == NULL) {
+        return NULL;
+    }
+    for (n = 0; n < record->ndigis; ++n) {
+        name = records_callsign(self, record->digis[n],
+            record->repeated & (1 << n));
+        if (name == NULL) {
+            Py_DECREF(digis);
+            return NULL;
+        }
+        PyTuple_SET_ITEM(digis, n, name);
+    }
+    if ((dest = records_callsign(self, record->dest, 0)) == NULL) {
+        Py_DECREF(digis);
+        return NULL;
+    }
+    if ((src = records_callsign(self, record->src, 0)) == NULL) {
+        Py_DECREF(dest);
+        Py_DECREF(digis);
+        return NULL;
+    }
+
+    if (record->flags & RECORD_PID) {
+        pid = PyInt_FromLong(record->pid);
+    } else {
+        pid = Py_None;
+        Py_INCREF(pid);
+    }
+
+    frame = PySequence_Fast_GET_ITEM(self->frames, record->frame);
+    return Py_BuildValue("(NNNiNs#)",
+        dest,
+        src,
+        digis,
+        (int) record->control,
+        pid,
+        PyString_AS_STRING(frame) + record->info_offset,
+        (int) record->info_length);
+}
+
+static Py_ssize_t
+py_records_readbuffer(RecordsObject *self, Py_ssize_t segment, void **ptr) {
+    if (segment != 0) {
+        PyErr_SetString(PyExc_SystemError, "accessing non-existent segment");
+        return -1;
+    }
+    *ptr = self->records;
+    return self->count * sizeof(ax25_record);
+}
+
+static Py_ssize_t
+py_records_segcount(RecordsObject *self, Py_ssize_t *len) {
+    if (len) {
+        *len = self->count * sizeof(ax25_record);
+    }
+    return 1;
+}
+
+static int
+py_records_getbuffer(RecordsObject *self, Py_buffer *view, int flags) {
+    if (PyBuffer_FillInfo(view, (PyObject *) self, self->records,
+            self->count * sizeof(ax25_record), 1, flags) == -1) {
+        return -1;
+    }
+    view->itemsize = sizeof(ax25_record);
+    if (flags & PyBUF_FORMAT) {
+        view->format = record_format;
+    }
+    if ((flags & PyBUF_ND) == PyBUF_ND) {
+        view->shape = &self->count;
+    }
+    return 0;
+}
+
+static PyObject *
+py_records_frame(RecordsObject *self, PyObject *args) {
+    Py_ssize_t i;
+
+    if (!PyArg_ParseTuple(args, "n", &i)) {
+        return NULL;
+    }
+    if (i < 0 || i >= self->count) {
+        PyErr_SetString(PyExc_IndexError, "record index out of range");
+        return NULL;
+    }
+    return PyInt_FromLong(self->records[i].frame);
+}
+
+static PyObject *
+py_records_decoder(RecordsObject *self, void *closure) {
+    Py_INCREF(self->decoder);
+    return (PyObject *) self->decoder;
+}
+
+static PyObject *
+py_records_format(RecordsObject *self, void *closure) {
+    return PyString_FromString(record_format);
+}
+
+/* Parse "CALL[-SSID][*]" into an address field, without the flag bits */
+static int
+encode_callsign(const char *call, Py_ssize_t size, unsigned char *address,
+        int *repeated) {
+    Py_ssize_t i, n = 0;
+    int ssid = 0;
+
+    *repeated = size > 0 && call[size - 1] == '*';
+    if (*repeated) {
+        size--;
+    }
+
+    memset(address, ' ' << 1, 6);
+    for (i = 0; i < size && call[i] != '-'; ++i) {
+        char c = call[i];
+        if (c >= 'a' && c <= 'z') {
+            c -= 'a' - 'A';
+        }
+        if (n == 6 || !((c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9'))) {
+            return -1;
+        }
+        address[n++] = c << 1;
+    }
+    if (n == 0) {
+        return -1;
+    }
+    if (i < size) {
+        if (++i == size) {
+            return -1;
+        }
+        for (; i < size; ++i) {
+            if (call[i] < '0' || call[i] > '9' || (ssid = ssid * 10 + call[i] - '0') > 15) {
+                return -1;
+            }
+        }
+    }
+    address[6] = ADDRESS_SPARE | (ssid << 1);
+    return 0;
+}
+
+/* Address field of call into dst, going through the cache */
+static int
+encode_address(PyObject *cache, PyObject *call, unsigned char *dst,
+        unsigned char bits) {
+    PyObject *address;
+    unsigned char raw[ADDRESS_SIZE + 1];
+    int repeated;
+
+    if (!PyString_Check(call)) {
+        PyErr_SetString(PyExc_TypeError, "call signs must be strings");
+        return -1;
+    }
+
+    address = PyDict_GetItem(cache, call);
+    if (address == NULL) {
+        if (encode_callsign(PyString_AS_STRING(call), PyString_GET_SIZE(call),
+                raw, &repeated) == -1) {
+            PyErr_Format(PyExc_ValueError, "malformed call sign %s",
+                PyString_AS_STRING(call));
+            return -1;
+        }
+        if (repeated) {
+            raw[6] |= ADDRESS_CH;
+        }
+        if (PyDict_Size(cache) >= ENCODE_CACHE_SIZE) {
+            PyDict_Clear(cache);
+        }
+        if ((address = PyString_FromStringAndSize((char *) raw, ADDRESS_SIZE)) == NULL) {
+            return -1;
+        }
+        if (PyDict_SetItem(cache, call, address) == -1) {
+            Py_DECREF(address);
+            return -1;
+        }
+        Py_DECREF(address);
+    }
+
+    memcpy(dst, PyString_AS_STRING(address), ADDRESS_SIZE);
+    dst[6] |= bits;
+    return 0;
+}
+
+static PyObject *encode_cache;
+
+static PyObject *
+py_frame_encode(PyObject *self, PyObject *args, PyObject *kwargs) {
+    static char *keywords[] = {"dest", "src", "digis", "control", "pid", "info",
+        "command", NULL};
+    PyObject *dest, *src, *digis = NULL, *seq = NULL, *result;
+    const char *info = "";
+    int info_size = 0, control = 0x03, pid = 0xf0, command = 1;
+    Py_ssize_t i, ndigis = 0, size;
+    unsigned char *p;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "OO|Oiis#i", keywords, &dest,
+            &src, &digis, &control, &pid, &info, &info_size, &command)) {
+        return NULL;
+    }
+
+    if (digis != NULL && digis != Py_None) {
+        if ((seq = PySequence_Fast(digis, "digis must be a sequence")) == NULL) {
+            return NULL;
+        }
+        ndigis = PySequence_Fast_GET_SIZE(seq);
+        if (ndigis > MAX_DIGIS) {
+            Py_DECREF(seq);
+            PyErr_SetString(PyExc_ValueError, "too many digipeaters");
+            return NULL;
+        }
+    }
+
+    size = (2 + ndigis) * ADDRESS_SIZE + 2 + info_size;
+    if ((result = PyString_FromStringAndSize((char *) 0, size)) == NULL) {
+        Py_XDECREF(seq);
+        return NULL;
+    }
+
+    p = (unsigned char *) PyString_AS_STRING(result);
+    // Version 2 commands set C in the destination, responses in the source
+    if (encode_address(encode_cache, dest, p, command ? ADDRESS_CH : 0) == -1
+        || encode_address(encode_cache, src, p + ADDRESS_SIZE,
+            command ? 0 : ADDRESS_CH) == -1) {
+        goto error;
+    }
+    p += 2 * ADDRESS_SIZE;
+    for (i = 0; i < ndigis; ++i, p += ADDRESS_SIZE) {
+        if (encode_address(encode_cache, PySequence_Fast_GET_ITEM(seq, i), p, 0) == -1) {
+            goto error;
+        }
+    }
+    p[-1] |= ADDRESS_LAST;
+    Py_XDECREF(seq);
+
+    *p++ = (unsigned char) control;
+    if ((control & 0x01) == 0 || (control & 0xef) == 0x03) {
+        *p++ = (unsigned char) pid;
+    }
+    memcpy(p, info, info_size);
+    p += info_size;
+
+    if (_PyString_Resize(&result, p - (unsigned char *) PyString_AS_STRING(result)) == -1) {
+        return NULL;
+    }
+    return result;
+
+error:
+    Py_XDECREF(seq);
+    Py_DECREF(result);
+    return NULL;
+}
+
+static PyMethodDef Decoder_methods[] = {
+    {"decode",   (PyCFunction) py_decoder_decode,   METH_O,       decode__doc__},
+    {"callsign", (PyCFunction) py_decoder_callsign, METH_VARARGS, callsign__doc__},
+    {"clear",    (PyCFunction) py_decoder_clear,    METH_NOARGS,  clear__doc__},
+    {NULL, NULL} /* sentinel */
+};
+
+static PyMemberDef Decoder_members[] = {
+    {"hits",   T_ULONGLONG, offsetof(DecoderObject, hits),   READONLY, NULL},
+    {"misses", T_ULONGLONG, offsetof(DecoderObject, misses), READONLY, NULL},
+    {"errors", T_ULONGLONG, offsetof(DecoderObject, errors), READONLY, NULL},
+    {NULL} /* sentinel */
+};
+
+static PyGetSetDef Decoder_getset[] = {
+    {"callsigns", (getter) py_decoder_callsigns, NULL, NULL, NULL},
+    {NULL} /* sentinel */
+};
+
+static PyTypeObject DecoderType = {
+    PyObject_HEAD_INIT(NULL)
+    0,                              /* ob_size */
+    "_frame.Decoder",               /* tp_name */
+    sizeof(DecoderObject),          /* tp_basicsize */
+    0,                              /* tp_itemsize */
+    (destructor) py_decoder_dealloc, /* tp_dealloc */
+    0,                              /* tp_print */
+    0,                              /* tp_getattr */
+    0,                              /* tp_setattr */
+    0,                              /* tp_compare */
+    0,                              /* tp_repr */
+    0,                              /* tp_as_number */
+    0,                              /* tp_as_sequence */
+    0,                              /* tp_as_mapping */
+    0,                              /* tp_hash */
+    0,                              /* tp_call */
+    0,                              /* tp_str */
+    0,                              /* tp_getattro */
+    0,                              /* tp_setattro */
+    0,                              /* tp_as_buffer */
+    Py_TPFLAGS_DEFAULT,             /* tp_flags */
+    Decoder__doc__,                 /* tp_doc */
+    0,                              /* tp_traverse */
+    0,                              /* tp_clear */
+    0,                              /* tp_richcompare */
+    0,                              /* tp_weaklistoffset */
+    0,                              /* tp_iter */
+    0,                              /* tp_iternext */
+    Decoder_methods,                /* tp_methods */
+    Decoder_members,                /* tp_members */
+    Decoder_getset,                 /* tp_getset */
+    0,                              /* tp_base */
+    0,                              /* tp_dict */
+    0,                              /* tp_descr_get */
+    0,                              /* tp_descr_set */
+    0,                              /* tp_dictoffset */
+    0,                              /* tp_init */
+    0,                              /* tp_alloc */
+    py_decoder_new,                 /* tp_new */
+};
+
+static PyMethodDef Records_methods[] = {
+    {"frame", (PyCFunction) py_records_frame, METH_VARARGS, frame__doc__},
+    {NULL, NULL} /* sentinel */
+};
+
+static PyGetSetDef Records_getset[] = {
+    {"decoder", (getter) py_records_decoder, NULL, NULL, NULL},
+    {"format",  (getter) py_records_format,  NULL, NULL, NULL},
+    {NULL} /* sentinel */
+};
+
+static PySequenceMethods Records_as_sequence = {
+    (lenfunc) py_records_length,    /* sq_length */
+    0,                              /* sq_concat */
+    0,                              /* sq_repeat */
+    (ssizeargfunc) py_records_item, /* sq_item */
+};
+
+static PyBufferProcs Records_as_buffer = {
+    (readbufferproc) py_records_readbuffer, /* bf_getreadbuffer */
+    0,                                      /* bf_getwritebuffer */
+    (segcountproc) py_records_segcount,     /* bf_getsegcount */
+    0,                                      /* bf_getcharbuffer */
+    (getbufferproc) py_records_getbuffer,   /* bf_getbuffer */
+    0,                                      /* bf_releasebuffer */
+};
+
+static PyTypeObject RecordsType = {
+    PyObject_HEAD_INIT(NULL)
+    0,                              /* ob_size */
+    "_frame.Records",               /* tp_name */
+    sizeof(RecordsObject),          /* tp_basicsize */
+    0,                              /* tp_itemsize */
+    (destructor) py_records_dealloc, /* tp_dealloc */
+    0,                              /* tp_print */
+    0,                              /* tp_getattr */
+    0,                              /* tp_setattr */
+    0,                              /* tp_compare */
+    0,                              /* tp_repr */
+    0,                              /* tp_as_number */
+    &Records_as_sequence,           /* tp_as_sequence */
+    0,                              /* tp_as_mapping */
+    0,                              /* tp_hash */
+    0,                              /* tp_call */
+    0,                              /* tp_str */
+    0,                              /* tp_getattro */
+    0,                              /* tp_setattro */
+    &Records_as_buffer,             /* tp_as_buffer */
+    Py_TPFLAGS_DEFAULT | Py_TPFLAGS_HAVE_NEWBUFFER, /* tp_flags */
+    Records__doc__,                 /* tp_doc */
+    0,                              /* tp_traverse */
+    0,                              /* tp_clear */
+    0,                              /* tp_richcompare */
+    0,                              /* tp_weaklistoffset */
+    0,                              /* tp_iter */
+    0,                              /* tp_iternext */
+    Records_methods,                /* tp_methods */
+    0,                              /* tp_members */
+    Records_getset,                 /* tp_getset */
+};
+
+static PyMethodDef _frame_methods[] = {
+    {"encode", (PyCFunction) py_frame_encode, METH_VARARGS | METH_KEYWORDS, encode__doc__},
+    {NULL, NULL} /* sentinel */
+};
+
+PyMODINIT_FUNC
+init_frame(void) {
+    PyObject *m, *decoder = (PyObject *) &DecoderType,
+        *records = (PyObject *) &RecordsType;
+
+    if (PyType_Ready(&DecoderType) < 0 || PyType_Ready(&RecordsType) < 0)
+        return;
+
+    if ((encode_cache = PyDict_New()) == NULL)
+        return;
+
+    m = Py_InitModule3("_frame", _frame_methods,
+        _frame__doc__);
+    if (m == NULL)
+        return;
+
+    Py_INCREF(decoder);
+    PyModule_AddObject(m, "Decoder", decoder);
+    Py_INCREF(records);
+    PyModule_AddObject(m, "Records", records);
+    PyModule_AddIntConstant(m, "RECORD_SIZE", sizeof(ax25_record));
+    PyModule_AddIntConstant(m, "MAX_DIGIS",   MAX_DIGIS);
+}
@@ -0,0 +1,422 @@
+#include <Python.h>
+#include <structmember.h>
+
+#include <string.h>
+
+/*
+ * KISS framing, as spoken by TNCs over serial lines.
+ *
+ * Frames are delimited by FEND, FEND and FESC in the payload are escaped as
+ * FESC TFEND and FESC TFESC. The first byte of every frame holds the port in
+ * the high nibble and the command in the low nibble.
+ *
+ * Payloads rarely contain FEND or FESC, so both the encoder and the decoder
+ * find them with memchr, which libc vectorizes, and copy the runs in between
+ * with memcpy instead of looking at every byte.
+ */
+#define FEND  0xc0
+#define FESC  0xdb
+#define TFEND 0xdc
+#define TFESC 0xdd
+
+// Largest frame a Decoder accepts by default, AX.25 frames are far smaller
+#ifndef DEFAULT_MAXSIZE
+#define DEFAULT_MAXSIZE 4096
+#endif
+
+/* The module doc string */
+PyDoc_STRVAR(_kiss__doc__, "KISS TNC framing.");
+
+/* The function doc string */
+PyDoc_STRVAR(encode__doc__,       "encode(frame[, port[, command]]) -> data\n\nEscape and delimit a single frame.");
+PyDoc_STRVAR(encode_batch__doc__, "encode_batch(frames[, port[, command]]) -> data\n\nEscape and delimit a sequence of frames into one buffer.");
+PyDoc_STRVAR(Decoder__doc__,      "Decoder([maxsize])\n\nIncremental decoder of a KISS byte stream.");
+PyDoc_STRVAR(feed__doc__,         "feed(data) -> [(port, command, frame), ...]\n\nDecode data, returning all frames it completes.");
+PyDoc_STRVAR(reset__doc__,        "reset()\n\nDrop the partial frame and wait for the next FEND.");
+
+typedef struct {
+    PyObject_HEAD
+    unsigned char *buffer;
+    Py_ssize_t length;
+    Py_ssize_t maxsize;
+    int synced;
+    int escaped;
+    int dropping;
+    unsigned long long frames;
+    unsigned long long errors;
+} DecoderObject;
+
+/* Escape size bytes from src into dst, returns the number of bytes written */
+static Py_ssize_t
+kiss_escape(unsigned char *dst, const unsigned char *src, Py_ssize_t size) {
+    const unsigned char *end = src + size, *fend, *fesc, *next;
+    unsigned char *start = dst;
+
+    fend = memchr(src, FEND, size);
+    fesc = memchr(src, FESC, size);
+    while (src < end) {
+        if (fend == NULL && fesc == NULL) {
+            memcpy(dst, src, end - src);
+            dst += end - src;
+            break;
+        }
+        next = fend == NULL || (fesc != NULL && fesc < fend) ? fesc : fend;
+        memcpy(dst, src, next - src);
+        dst += next - src;
+        *dst++ = FESC;
+        *dst++ = *next == FEND ? TFEND : TFESC;
+        src = next + 1;
+        if (next == fend) {
+            fend = memchr(src, FEND, end - src);
+        } else {
+            fesc = memchr(src, FESC, end - src);
+        }
+    }
+    return dst - start;
+}
+
+static PyObject *
+py_kiss_encode(PyObject *self, PyObject *args) {
+    const char *frame;
+    int size, port = 0, command = 0;
+    unsigned char *dst;
+    Py_ssize_t n;
+    PyObject *result;
+
+    if (!PyArg_ParseTuple(args, "s#|ii", &frame, &size, &port, &command)) {
+        return NULL;
+    }
+
+    // Worst case every byte is escaped
+    result = PyString_FromStringAndSize((char *) 0, (Py_ssize_t) size * 2 + 3);
+    if (result == NULL) {
+        return NULL;
+    }
+
+    dst = (unsigned char *) PyString_AS_STRING(result);
+    dst[0] = FEND;
+    dst[1] = ((port & 0x0f) << 4) | (command & 0x0f);
+    n = kiss_escape(dst + 2, (const unsigned char *) frame, size) + 2;
+    dst[n++] = FEND;
+
+    if (_PyString_Resize(&result, n) == -1) {
+        return NULL;
+    }
+    return result;
+}
+
+static PyObject *
+py_kiss_encode_batch(PyObject *self, PyObject *args) {
+    PyObject *frames, *seq, *result, *item;
+    int port = 0, command = 0;
+    Py_ssize_t i, count, total = 0, n = 0;
+    unsigned char *dst;
+
+    if (!PyArg_ParseTuple(args, "O|ii", &frames, &port, &command)) {
+        return NULL;
+    }
+
+    if ((seq = PySequence_Fast(frames, "frames must be a sequence")) == NULL) {
+        return NULL;
+    }
+
+    count = PySequence_Fast_GET_SIZE(seq);
+    for (i = 0; i < count; ++i) {
+        item = PySequence_Fast_GET_ITEM(seq, i);
+        if (!PyString_Check(item)) {
+            Py_DECREF(seq);
+            PyErr_SetString(PyExc_TypeError, "frames must be strings");
+            return NULL;
+        }
+        total += PyString_GET_SIZE(item) * 2 + 3;
+    }
+
+    if ((result = PyString_FromStringAndSize((char *) 0, total)) == NULL) {
+        Py_DECREF(seq);
+        return NULL;
+    }
+
+    dst = (unsigned char *) PyString_AS_STRING(result);
+    for (i = 0; i < count; ++i) {
+        item = PySequence_Fast_GET_ITEM(seq, i);
+        // Back to back frames share the FEND in between
+        if (i == 0) {
+            dst[n++] = FEND;
+        }
+        dst[n++] = ((port & 0x0f) << 4) | (command & 0x0f);
+        n += kiss_escape(dst + n, (const unsigned char *) PyString_AS_STRING(item),
+            PyString_GET_SIZE(item));
+        dst[n++] = FEND;
+    }
+    Py_DECREF(seq);
+
+    if (_PyString_Resize(&result, n) == -1) {
+        return NULL;
+    }
+    return result;
+}
+
+/* Append bytes to the partial frame, dropping the frame if it grows too big */
+static inline void
+decoder_append(DecoderObject *self, const unsigned char *src, Py_ssize_t size) {
+    if (self->dropping) {
+        return;
+    }
+    if (self->length + size > self->maxsize + 1) {
+        self->dropping = 1;
+        self->errors++;
+        return;
+    }
+    memcpy(self->buffer + self->length, src, size);
+    self->length += size;
+}
+
+/* Hand out the partial frame, if any, and start a new one */
+static int
+decoder_finish(DecoderObject *self, PyObject *frames) {
+    PyObject *item;
+    unsigned char type;
+    int result = 0;
+
+    if (self->escaped) {
+        // FESC right before FEND
+        self->errors++;
+    } else if (self->length && !self->dropping) {
+        type = self->buffer[0];
+        item = Py_BuildValue("(iis#)", type >> 4, type & 0x0f,
+            self->buffer + 1, (int) (self->length - 1));
+        if (item == NULL || PyList_Append(frames, item) == -1) {
+            result = -1;
+        }
+        Py_XDECREF(item);
+        self->frames++;
+    }
+
+    self->length = 0;
+    self->escaped = 0;
+    self->dropping = 0;
+    return result;
+}
+
+static PyObject *
+py_decoder_new(PyTypeObject *type, PyObject *args, PyObject *kwargs) {
+    DecoderObject *self;
+    Py_ssize_t maxsize = DEFAULT_MAXSIZE;
+
+    if (!PyArg_ParseTuple(args, "|n", &maxsize)) {
+        return NULL;
+    }
+
+    if (maxsize <= 0) {
+        PyErr_SetString(PyExc_ValueError, "maxsize must be positive");
+        return NULL;
+    }
+
+    if ((self = (DecoderObject *) type->tp_alloc(type, 0)) == NULL) {
+        return NULL;
+    }
+
+    // One extra byte for the port and command
+    if ((self->buffer = PyMem_Malloc(maxsize + 1)) == NULL) {
+        Py_DECREF(self);
+        return PyErr_NoMemory();
+    }
+    self->maxsize = maxsize;
+    return (PyObject *) self;
+}
+
+static void
+py_decoder_dealloc(DecoderObject *self) {
+    PyMem_Free(self->buffer);
+    Py_TYPE(self)->tp_free((PyObject *) self);
+}
+
+static PyObject *
+py_decoder_feed(DecoderObject *self, PyObject *args) {
+    const unsigned char *src, *end, *fend, *limit, *fesc;
+    int size;
+    unsigned char byte;
+    PyObject *frames;
+
+    if (!PyArg_ParseTuple(args, "s#", &src, &size)) {
+        return NULL;
+    }
+
+    if ((frames = PyList_New(0)) == NULL) {
+        return NULL;
+    }
+
+    end = src + size;
+    while (src < end) {
+        // Skip line noise until the first FEND
+        if (!self->synced) {
+            if ((fend = memchr(src, FEND, end - src)) == NULL) {
+                break;
+            }
+            self->synced = 1;
+            src = fend + 1;
+            continue;
+        }
+
+        // Escape split over two reads
+        if (self->escaped) {
+            byte = *src;
+            if (byte == FEND) {
+                if (decoder_finish(self, frames) == -1) {
+                    goto error;
+                }
+                src++;
+                continue;
+            }
+            self->escaped = 0;
+            if (byte == TFEND || byte == TFESC) {
+                byte = byte == TFEND ? FEND : FESC;
+                decoder_append(self, &byte, 1);
+                src++;
+            } else {
+                // Drop the stray FESC, the byte is taken as is
+                self->errors++;
+            }
+            continue;
+        }
+
+        fend = memchr(src, FEND, end - src);
+        limit = fend ? fend : end;
+        while (src < limit) {
+            if ((fesc = memchr(src, FESC, limit - src)) == NULL) {
+                decoder_append(self, src, limit - src);
+                src = limit;
+                break;
+            }
+            decoder_append(self, src, fesc - src);
+            if (fesc + 1 == limit) {
+                // Resolved by the next byte, possibly in the next read
+                self->escaped = 1;
+                src = limit;
+                break;
+            }
+            byte = fesc[1];
+            if (byte == TFEND || byte == TFESC) {
+                byte = byte == TFEND ? FEND : FESC;
+                decoder_append(self, &byte, 1);
+                src = fesc + 2;
+            } else {
+                // Drop the stray FESC, the byte is taken as is
+                self->errors++;
+                src = fesc + 1;
+            }
+        }
+
+        if (fend != NULL) {
+            if (decoder_finish(self, frames) == -1) {
+                goto error;
+            }
+            src = fend + 1;
+        }
+    }
+    return frames;
+
+error:
+    Py_DECREF(frames);
+    return NULL;
+}
+
+static PyObject *
+py_decoder_reset(DecoderObject *self, PyObject *unused) {
+    self->length = 0;
+    self->synced = 0;
+    self->escaped = 0;
+    self->dropping = 0;
+    Py_RETURN_NONE;
+}
+
+static PyObject *
+py_decoder_pending(DecoderObject *self, void *closure) {
+    return PyInt_FromSsize_t(self->length);
+}
+
+static PyMethodDef Decoder_methods[] = {
+    {"feed",  (PyCFunction) py_decoder_feed,  METH_VARARGS, feed__doc__},
+    {"reset", (PyCFunction) py_decoder_reset, METH_NOARGS,  reset__doc__},
+    {NULL, NULL} /* sentinel */
+};
+
+static PyMemberDef Decoder_members[] = {
+    {"maxsize", T_PYSSIZET,   offsetof(DecoderObject, maxsize), READONLY, NULL},
+    {"frames",  T_ULONGLONG,  offsetof(DecoderObject, frames),  READONLY, NULL},
+    {"errors",  T_ULONGLONG,  offsetof(DecoderObject, errors),  READONLY, NULL},
+    {NULL} /* sentinel */
+};
+
+static PyGetSetDef Decoder_getset[] = {
+    {"pending", (getter) py_decoder_pending, NULL, NULL, NULL},
+    {NULL} /* sentinel */
+};
+
+static PyTypeObject DecoderType = {
+    PyObject_HEAD_INIT(NULL)
+    0,                              /* ob_size */
+    "_kiss.Decoder",                /* tp_name */
+    sizeof(DecoderObject),          /* tp_basicsize */
+    0,                              /* tp_itemsize */
+    (destructor) py_decoder_dealloc, /* tp_dealloc */
+    0,                              /* tp_print */
+    0,                              /* tp_getattr */
+    0,                              /* tp_setattr */
+    0,                              /* tp_compare */
+    0,                              /* tp_repr */
+    0,                              /* tp_as_number */
+    0,                              /* tp_as_sequence */
+    0,                              /* tp_as_mapping */
+    0,                              /* tp_hash */
+    0,                              /* tp_call */
+    0,                              /* tp_str */
+    0,                              /* tp_getattro */
+    0,                              /* tp_setattro */
+    0,                              /* tp_as_buffer */
+    Py_TPFLAGS_DEFAULT,             /* tp_flags */
+    Decoder__doc__,                 /* tp_doc */
+    0,                              /* tp_traverse */
+    0,                              /* tp_clear */
+    0,                              /* tp_richcompare */
+    0,                              /* tp_weaklistoffset */
+    0,                              /* tp_iter */
+    0,                              /* tp_iternext */
+    Decoder_methods,                /* tp_methods */
+    Decoder_members,                /* tp_members */
+    Decoder_getset,                 /* tp_getset */
+    0,                              /* tp_base */
+    0,                              /* tp_dict */
+    0,                              /* tp_descr_get */
+    0,                              /* tp_descr_set */
+    0,                              /* tp_dictoffset */
+    0,                              /* tp_init */
+    0,                              /* tp_alloc */
+    py_decoder_new,                 /* tp_new */
+};
+
+static PyMethodDef _kiss_methods[] = {
+    {"encode",       py_kiss_encode,       METH_VARARGS, encode__doc__},
+    {"encode_batch", py_kiss_encode_batch, METH_VARARGS, encode_batch__doc__},
+    {NULL, NULL} /* sentinel */
+};
+
+PyMODINIT_FUNC
+init_kiss(void) {
+    PyObject *m, *type = (PyObject *) &DecoderType;
+
+    if (PyType_Ready(&DecoderType) < 0)
+        return;
+
+    m = Py_InitModule3("_kiss", _kiss_methods,
+        _kiss__doc__);
+    if (m == NULL)
+        return;
+
+    Py_INCREF(type);
+    PyModule_AddObject(m, "Decoder", type);
+    PyModule_AddIntConstant(m, "FEND",  FEND);
+    PyModule_AddIntConstant(m, "FESC",  FESC);
+    PyModule_AddIntConstant(m, "TFEND", TFEND);
+    PyModule_AddIntConstant(m, "TFESC", TFESC);
+}
@@ -0,0 +1,53 @@
+from net.async import tcp
+from net.async.multiplexer import Multiplexer
+import errno
+import os
+import resource
+import socket
+
+def tests():
+    '''
+    A listener that runs out of descriptors reports it and backs off, and
+    accepts what is left in the backlog once descriptors are free again.
+    '''
+    async = Multiplexer()
+    server = tcp.Server(('127.0.0.1', 0), async=async)
+    server.accept_backoff = 0.05
+    accepted = []
+    errors = []
+    server.hook('accept', accepted.append)
+    server.hook('error', lambda conn, error: errors.append(error.errno))
+    pauses = []
+    server.hook('pause', lambda conn, queue: pauses.append(queue))
+
+    clients = [socket.create_connection(server.address) for x in range(4)]
+    # Room for two more descriptors
+    probe = os.dup(0)
+    os.close(probe)
+    limits = resource.getrlimit(resource.RLIMIT_NOFILE)
+    resource.setrlimit(resource.RLIMIT_NOFILE, (probe + 2, limits[1]))
+    try:
+        async.later(0.02, async.stop)
+        async.run()
+        full = len(accepted) == 2 and errors[:1] == [errno.EMFILE] \
+            and pauses == ['recv'] and server.is_paused('recv')
+    finally:
+        resource.setrlimit(resource.RLIMIT_NOFILE, limits)
+    print 'full', len(accepted), errors, pauses, full
+
+    async.later(0.2, async.stop)
+    async.run()
+    resumed = len(accepted) == 4 and server.socket is not None \
+        and not server.is_paused('recv')
+    print 'resumed', len(accepted), resumed
+
+    for conn in accepted:
+        conn.close()
+    for sock in clients:
+        sock.close()
+    server.close()
+    return full and resumed
+
+if __name__ == '__main__':
+    if not tests():
+        raise SystemExit(1)
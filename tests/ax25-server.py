@@ -1,8 +1,10 @@
+from net.async import ax25 as async_ax25
+from net.async.multiplexer import Multiplexer
 from net.family import ax25
 import sys
 
 def tests():
-    call = '\x9c\x98`\x9a\xb4@\x10"E'
+    call = '\x9c\x98`\x9a\xb4@\x10'
     print ax25.null_address()
     data = ax25.aton('NL0MZ-8')
     print repr(data)
@@ -16,19 +18,27 @@ def tests():
             print 'ERROR', e
 
 def hello_bbs(call):
-    print 'sock = ax25.socket()'
-    sock = ax25.socket()
-    print 'sock', sock
-    print 'sock.bind("%s")' % (call,)
-    sock.bind(call)
-    print 'sock.listen(10)'
-    sock.listen(10)
-    while True:
-        call, client = sock.accept()
-        print 'new client', call
+    async = Multiplexer.shared()
+    print 'server = async_ax25.Server("%s")' % (call,)
+    server = async_ax25.Server(call, async=async)
 
-        print >>client, 'Hi thar, this is packet radio from Python'
-        client.close()
+    def on_recv(station, frame):
+        line = station.read().rstrip('\r')
+        if line.lower() in ('b', 'bye'):
+            station.close()
+        else:
+            station.send_line('%s said: %s' % (station.address, line))
+
+    def on_accept(station):
+        print 'new client', station.address, \
+            '(%d connected)' % (len(server.stations),)
+        station.hook('recv', on_recv)
+        station.hook('close', lambda station: \
+            sys.stdout.write('bye %s\n' % (station.address,)))
+        station.send_line('Hi thar, this is packet radio from Python')
+
+    server.hook('accept', on_accept)
+    async.run()
      
 if __name__ == '__main__':
     if len(sys.argv) != 2:
@@ -0,0 +1,133 @@
+from net.async import tcp
+from net.async.capture import (CLOSE, OPEN, RECV, SEND, Capture, Replay,
+    read_capture)
+from net.async.multiplexer import Multiplexer
+import os
+import tempfile
+
+def server(async, prefix='ok ', greeting=None):
+    server = tcp.Server(('127.0.0.1', 0), async=async)
+
+    def accept(conn):
+        conn.hook('recv', lambda conn, chunk: conn.send(prefix + conn.read()))
+        if greeting:
+            conn.send(greeting)
+    server.hook('accept', accept)
+    return server
+
+def talk(async, address, requests, greeting=''):
+    '''
+    One client connection, sending the next request once the answer to the
+    previous one is in, and closing after the last.
+    '''
+    conn = tcp.Client(address, async=async)
+    requests = list(requests)
+    conn.expected = len(greeting)
+
+    def next(conn):
+        if requests:
+            conn.expected = 3 + len(requests[0])
+            conn.send(requests.pop(0))
+        else:
+            conn.close()
+
+    def recv(conn, chunk):
+        if conn.recv_queued >= conn.expected:
+            conn.read()
+            async.later(0.01, next, conn)
+    conn.retain = True
+    conn.hook('recv', recv)
+    conn.connect(callback=not greeting and next or None)
+    return conn
+
+def record(path, data=('recv', 'send')):
+    async = Multiplexer()
+    listener = server(async)
+    listener.capture = Capture(path, size=65536, data=data)
+    talk(async, listener.address, ['one', 'two', 'three'])
+    async.later(0.02, talk, async, listener.address, ['four'])
+    async.later(0.3, async.stop)
+    async.run()
+    listener.close()
+    stats = listener.capture.stats()
+    listener.capture.close()
+    return stats
+
+def capture(path):
+    stats = record(path)
+    records = list(read_capture(path))
+    kinds = [(ident, kind, data) for when, ident, kind, length, data
+        in records]
+    first = [(kind, data) for ident, kind, data in kinds if ident == 1]
+    ok = stats['connections'] == 2 and stats['dropped'] == 0 \
+        and first == [(OPEN, ''), (RECV, 'one'), (SEND, 'ok one'),
+            (RECV, 'two'), (SEND, 'ok two'), (RECV, 'three'),
+            (SEND, 'ok three'), (CLOSE, '')]
+    times = [when for when, ident, kind, length, data in records]
+    ok = ok and times == sorted(times) and len(records) == stats['records']
+    print 'capture', stats, ok
+    return ok
+
+def replay(path):
+    async = Multiplexer()
+    listener = server(async)
+    report = Replay(path, listener.address, speed=2, async=async).run(
+        timeout=5)
+    ok = report['requests'] == 4 and report['completed'] == 4 \
+        and report['errors'] == 0 and report['mismatched'] == 0 \
+        and report['bytes'] == {'send': 15, 'recv': 27}
+    print 'replay', report['completed'], report['errors'], \
+        report['seconds'], report['baseline_seconds'], ok
+    listener.close()
+
+    # A server that answers differently is caught
+    other = server(async, 'no ')
+    report = Replay(path, other.address, speed=4, async=async).run(
+        timeout=5)
+    changed = report['completed'] == 4 and report['mismatched'] == 4
+    print 'changed answers', report['mismatched'], changed
+    other.close()
+    return ok and changed
+
+def greeting(path):
+    # A server that speaks first, its greeting does not shift the answers
+    async = Multiplexer()
+    listener = server(async, greeting='hello\r\n')
+    listener.capture = Capture(path, size=65536)
+    talk(async, listener.address, ['one', 'two'], 'hello\r\n')
+    async.later(0.2, async.stop)
+    async.run()
+    listener.capture.close()
+    listener.close()
+
+    other = server(async, greeting='hello\r\n')
+    report = Replay(path, other.address, speed=4, async=async).run(
+        timeout=5)
+    ok = report['requests'] == 3 and report['completed'] == 3 \
+        and report['errors'] == 0 and report['mismatched'] == 0
+    print 'greeting', report['completed'], report['mismatched'], ok
+    other.close()
+    return ok
+
+def lengths(path):
+    # Answers kept only by their length still pace the replay
+    record(path, data=('recv',))
+    async = Multiplexer()
+    listener = server(async, 'no ')
+    report = Replay(path, listener.address, speed=4, async=async).run(
+        timeout=5)
+    ok = report['completed'] == 4 and report['mismatched'] == 0
+    print 'lengths only', report['completed'], ok
+    listener.close()
+    return ok
+
+if __name__ == '__main__':
+    fd, path = tempfile.mkstemp()
+    os.close(fd)
+    try:
+        ok = capture(path) and replay(path) and lengths(path) \
+            and greeting(path)
+    finally:
+        os.unlink(path)
+    if not ok:
+        raise SystemExit(1)
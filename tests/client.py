@@ -0,0 +1,29 @@
+from net.async import tcp
+from net.async.multiplexer import Multiplexer
+import os
+import socket
+
+def descriptors():
+    return len(os.listdir('/proc/self/fd'))
+
+def tests():
+    '''
+    A connection made from a descriptor takes it over, closing the
+    connection leaves no descriptor behind.
+    '''
+    async = Multiplexer()
+    server = tcp.Server(('127.0.0.1', 0), async=async)
+    before = descriptors()
+    for x in range(10):
+        sock = socket.create_connection(server.address)
+        conn = tcp.Client(os.dup(sock.fileno()), async=async)
+        sock.close()
+        conn.close()
+    leaked = descriptors() - before
+    print 'from descriptor', leaked
+    server.close()
+    return leaked == 0
+
+if __name__ == '__main__':
+    if not tests():
+        raise SystemExit(1)
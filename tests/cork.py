@@ -0,0 +1,46 @@
+from net.async import tcp
+from net.async.multiplexer import Multiplexer
+import socket
+
+def tests():
+    '''
+    A corked connection holds on to what it sends over several loop
+    iterations, and writes it out at once on uncork.
+    '''
+    async = Multiplexer()
+    server = tcp.Server(('127.0.0.1', 0), async=async)
+    accepted = []
+    server.hook('accept', accepted.append)
+    sock = socket.create_connection(server.address)
+    sock.setblocking(False)
+    async.later(0.02, async.stop)
+    async.run()
+    conn = accepted[0]
+
+    def peer():
+        try:
+            return sock.recv(4096)
+        except socket.error:
+            return ''
+
+    conn.cork()
+    for part in ('one ', 'two ', 'three'):
+        conn.send(part)
+        async.later(0.01, async.stop)
+        async.run()
+    held = peer() == '' and conn.send_queued == 13 and conn.send_calls == 0
+
+    conn.uncork()
+    async.later(0.01, async.stop)
+    async.run()
+    sent = peer() == 'one two three' and conn.send_queued == 0 \
+        and conn.send_calls == 1
+    print 'cork', held, sent
+    sock.close()
+    conn.close()
+    server.close()
+    return held and sent
+
+if __name__ == '__main__':
+    if not tests():
+        raise SystemExit(1)
@@ -0,0 +1,37 @@
+from net.family import frame
+import random
+
+def frames(count=3000):
+    rand = random.Random(7)
+    result = []
+    for number in xrange(count):
+        digis = ['WIDE%d-%d*' % (number % 3, number % 7)] if number % 2 else []
+        result.append(frame.encode('APRS', 'PD%dAB-%d' % (number % 100,
+            number % 16), digis, info='>%d' % (number,)))
+    # Cut off in the address fields, these have to be rejected
+    broken = [f[:rand.randrange(8, 14)] for f in result[:500]]
+    return result, broken
+
+def check(decoder):
+    good, broken = frames()
+    records = decoder.decode(good)
+    before = [records[i] for i in xrange(len(records))]
+
+    # Rejected frames leave the call sign table alone
+    decoder.clear()
+    decoder.decode(broken)
+    rejected = decoder.callsigns == 0 and decoder.errors == len(broken)
+
+    # Records decoded before the clear keep their call signs
+    decoder.decode(good[:10])
+    after = [records[i] for i in xrange(len(records))]
+    kept = after == before and len(before) == len(good)
+    print decoder.__class__.__name__, rejected, kept
+    return rejected and kept
+
+if __name__ == '__main__':
+    ok = check(frame.PyDecoder())
+    if frame._frame:
+        ok = check(frame.Decoder()) and ok
+    if not ok:
+        raise SystemExit(1)
@@ -0,0 +1,155 @@
+from net.async import handoff, tcp
+from net.async.multiplexer import Multiplexer
+from net.family import _bare
+import errno
+import os
+import socket
+import threading
+
+def worker(sock):
+    '''
+    Answers on the connections it gets handed, first on their own and then
+    on the ones it accepts on the listener it takes over.
+    '''
+    async = Multiplexer()
+    channel = handoff.Channel(sock, async=async)
+
+    def serve(conn, tag):
+        conn.hook('recv', lambda conn, chunk: conn.send('%s %d %s' % (tag,
+            os.getpid(), conn.read())))
+
+    def connection(channel, conn, tag):
+        serve(conn, tag)
+
+    def listener(channel, sock, tag):
+        server = tcp.Server(sock, async=async)
+        server.hook('accept', lambda conn: serve(conn, tag))
+
+    channel.hook('connection', connection)
+    channel.hook('listener', listener)
+    channel.hook('close', lambda conn: async.stop())
+    async.run()
+
+def ask(address, data):
+    sock = socket.create_connection(address)
+    sock.sendall(data)
+    answer = sock.recv(4096)
+    sock.close()
+    return answer.split(' ', 2)
+
+def tests():
+    front, back = handoff.pair()
+    pid = os.fork()
+    if pid == 0:
+        front.close()
+        try:
+            worker(back)
+        finally:
+            os._exit(0)
+    back.close()
+
+    async = Multiplexer()
+    channel = handoff.Channel(front, async=async)
+    server = tcp.Server(('127.0.0.1', 0), async=async)
+    address = server.address
+
+    def sniff(conn, chunk):
+        # Route on the first bytes, the worker gets them along
+        channel.handoff(conn, chunk.startswith('a') and 'shard-a' or 'other')
+        async.stop()
+    server.hook('accept', lambda conn: conn.hook('recv', sniff))
+
+    results = []
+    for data in ('abc', 'xyz'):
+        # The client blocks, the loop accepts and hands off meanwhile
+        thread = threading.Thread(target=lambda: results.append(ask(address,
+            data)))
+        thread.start()
+        async.run()
+        thread.join()
+    ok = results == [['shard-a', str(pid), 'abc'], ['other', str(pid), 'xyz']]
+    print 'handoff', results, ok
+
+    # Hand the listener over, the worker accepts from now on
+    channel.handoff(server, 'takeover')
+    async.later(0.05, async.stop)
+    async.run()
+    answer = ask(address, 'hello')
+    taken = answer == ['takeover', str(pid), 'hello']
+    print 'listener', answer, channel.sent, taken
+
+    # A connection that cannot be handed off stays as it is
+    busy = tcp.Server(('127.0.0.1', 0), async=async)
+    accepted = []
+
+    def keep(conn):
+        conn.retain = True
+        conn.hook('recv', lambda conn, chunk: None)
+        accepted.append(conn)
+    busy.hook('accept', keep)
+    sock = socket.socket()
+    sock.setsockopt(socket.SOL_SOCKET, socket.SO_RCVBUF, 4096)
+    sock.connect(busy.address)
+    sock.sendall('y' * 100)
+    async.later(0.05, async.stop)
+    async.run()
+    conn = accepted[0]
+
+    # What it received does not fit in a message
+    channel.max_message = 64
+    try:
+        channel.handoff(conn)
+        kept = False
+    except IOError, e:
+        kept = e.errno == errno.EMSGSIZE and conn.socket is not None \
+            and conn.states is not None and conn.recv_queued == 100
+    del channel.max_message
+    print 'too big', kept
+
+    # What was queued to send goes out first, unless it does not fit
+    conn.read()
+    conn.set_option(socket.TCP_NODELAY, 1)
+    conn.socket.setsockopt(socket.SOL_SOCKET, socket.SO_SNDBUF, 4096)
+    conn.send('x' * 200000)
+    try:
+        channel.handoff(conn)
+        refused = False
+    except IOError, e:
+        refused = e.errno == errno.EBUSY and conn.socket is not None
+    print 'busy', refused, channel.sent
+    sock.close()
+    conn.close()
+    busy.close()
+
+    channel.close()
+    os.waitpid(pid, 0)
+    return ok and taken and refused and kept and channel.sent == 3
+
+def lost():
+    '''
+    Messages that arrive truncated or without a socket are counted, and the
+    channel carries on with the next one.
+    '''
+    async = Multiplexer()
+    sender, sock = handoff.pair()
+    channel = handoff.Channel(sock, async=async)
+    channel.max_message = 64
+    errors = []
+    channel.hook('error', lambda channel, error: errors.append(error.errno))
+
+    spare = socket.socket()
+    _bare.send_fds(sender.fileno(), 'x' * 100, [spare.fileno()])
+    sender.send('no socket')
+    async.later(0.05, async.stop)
+    async.run()
+    ok = errors == [errno.EMSGSIZE, errno.EBADMSG] and channel.lost == 2 \
+        and channel.adopted == 0 and channel.socket is not None
+    print 'lost', errors, channel.lost, ok
+    spare.close()
+    sender.close()
+    channel.close()
+    return ok
+
+if __name__ == '__main__':
+    if not (tests() and lost()):
+        raise SystemExit(1)
@@ -0,0 +1,84 @@
+from net.async import kiss as async_kiss
+from net.async.multiplexer import Multiplexer
+from net.family import kiss
+import os
+import random
+import sys
+
+def tests():
+    frames = ['hello', '\xc0\xdb\xdc\xdd', '', 'x' * 300]
+    print repr(kiss.encode('\xc0hi\xdb', 2, kiss.TXDELAY))
+    data = kiss.encode_batch(frames, 1)
+    print repr(data) == repr(kiss.py_encode_batch(frames, 1))
+    # Frames must survive being cut up at every possible offset
+    wanted = [(1, kiss.DATA, frame) for frame in frames]
+    for split in xrange(len(data)):
+        for decoder in (kiss.Decoder(), kiss.PyDecoder()):
+            decoded = decoder.feed(data[:split]) + decoder.feed(data[split:])
+            if decoded != wanted:
+                print 'MISMATCH', decoder, split, decoded
+                return False
+    print 'split decoding ok'
+    return True
+
+def loopback_tnc(fd, count):
+    '''
+    Stand in for a TNC that sends every frame straight back.
+    '''
+    decoder = kiss.Decoder()
+    while count > 0:
+        frames = [frame for port, command, frame in
+            decoder.feed(os.read(fd, 65536))]
+        data = kiss.encode_batch(frames)
+        while data:
+            data = data[os.write(fd, data):]
+        count -= len(frames)
+    # Hold on to the master until the host hangs up, closing it early would
+    # throw away what the host did not read yet
+    try:
+        while os.read(fd, 65536):
+            pass
+    except OSError:
+        pass
+
+def pty_pair(count):
+    '''
+    The master side of a pty plays the TNC, we talk to the slave side like we
+    would to a serial port.
+    '''
+    master, slave = os.openpty()
+    async_kiss.TNC.configure(master)
+    pid = os.fork()
+    if pid == 0:
+        os.close(slave)
+        loopback_tnc(master, count)
+        os._exit(0)
+    os.close(master)
+
+    async = Multiplexer()
+    tnc = async_kiss.TNC(os.ttyname(slave), async=async)
+    os.close(slave)
+
+    frames = [os.urandom(random.randint(16, 256)) for x in xrange(count)]
+    received = []
+    batches = [frames[offset:offset + 100] for offset in xrange(0, count, 100)]
+    def on_frame(tnc, port, frame):
+        received.append(frame)
+        if len(received) == count:
+            async.stop()
+        elif len(received) % 100 == 0 and batches:
+            tnc.send_frames(batches.pop(0))
+    tnc.hook('frame', on_frame)
+
+    # Keep a few batches in flight, the send queue is bounded
+    for batch in batches[:4]:
+        tnc.send_frames(batches.pop(0))
+    async.run()
+    print 'loopback', len(received), 'frames', received == frames
+    print tnc.stats()
+    tnc.close()
+    os.waitpid(pid, 0)
+
+if __name__ == '__main__':
+    if tests():
+        pty_pair(int(sys.argv[1]) if len(sys.argv) > 1 else 1000)
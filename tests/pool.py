@@ -0,0 +1,112 @@
+from net.async import tcp
+from net.async.multiplexer import Multiplexer
+from net.async.pool import Pool
+
+def echo_server(async):
+    server = tcp.Server(('127.0.0.1', 0), async=async)
+    server.accepted = []
+
+    def accept(conn):
+        server.accepted.append(conn)
+        conn.hook('recv', lambda conn, chunk: conn.send(conn.read()))
+    server.hook('accept', accept)
+    return server
+
+def request(async, pool, address, data):
+    '''
+    Check out a connection, send data and wait for the echo. The connection
+    is returned with the answer, it is not checked in.
+    '''
+    result = []
+
+    def recv(conn, chunk):
+        if conn.recv_queued >= len(data):
+            result.append((conn, conn.read()))
+            async.stop()
+
+    def ready(conn, error):
+        if error is not None:
+            result.append((None, error))
+            async.stop()
+            return
+        conn.retain = True
+        conn.hook('recv', recv)
+        conn.send(data)
+
+    pool.checkout(address, ready)
+    if not result:
+        async.run()
+    return result[0]
+
+def reuse():
+    async = Multiplexer()
+    server = echo_server(async)
+    pool = Pool(async)
+
+    first, answer = request(async, pool, server.address, 'one')
+    ok = answer == 'one'
+    pool.checkin(first)
+    # Left over data and hooks of the last user are gone
+    second, answer = request(async, pool, server.address, 'two')
+    ok = ok and second is first and answer == 'two' \
+        and len(server.accepted) == 1
+    pool.checkin(second)
+    print 'reuse', pool.stats(), ok
+
+    # A peer that closes an idle connection gets it dropped
+    server.accepted[0].close()
+    async.later(0.05, async.stop)
+    async.run()
+    ok = ok and pool.stats()['idle'] == 0
+    third, answer = request(async, pool, server.address, 'three')
+    ok = ok and third is not first and answer == 'three'
+    print 'peer closed', pool.stats(), ok
+    pool.checkin(third)
+    pool.close()
+    server.close()
+    return ok and pool.stats()['hit_rate'] == 0.3333
+
+def limits():
+    async = Multiplexer()
+    server = echo_server(async)
+    pool = Pool(async, min_idle=2, max_idle=3)
+    pool.check_interval = 0.05
+    pool.idle_timeout = 0.1
+
+    conns = [request(async, pool, server.address, 'x')[0] for x in xrange(5)]
+    for conn in conns:
+        pool.checkin(conn)
+    ok = pool.stats()['idle'] == 3 and pool.stats()['discarded'] == 2
+
+    # The idle ones beyond min_idle expire
+    async.later(0.3, async.stop)
+    async.run()
+    ok = ok and pool.stats()['idle'] == 2 and pool.stats()['expired'] == 1
+    print 'max idle and expiry', pool.stats(), ok
+
+    # Checking out below min_idle tops the address up again
+    conn, answer = request(async, pool, server.address, 'y')
+    async.later(0.1, async.stop)
+    async.run()
+    ok = ok and pool.stats()['idle'] == 2 and pool.stats()['hits'] == 1
+    print 'min idle', pool.stats(), ok
+    conn.close()
+    pool.close()
+    server.close()
+    # Nothing about the connections stays behind in the pool
+    return ok and not pool.since and not pool.connecting
+
+def refused():
+    async = Multiplexer()
+    server = echo_server(async)
+    address = server.address
+    server.close()
+    pool = Pool(async)
+    conn, error = request(async, pool, address, 'x')
+    ok = conn is None and error is not None and pool.stats()['failed'] == 1
+    print 'refused', error, ok
+    return ok and not pool.connecting
+
+if __name__ == '__main__':
+    if not (reuse() and limits() and refused()):
+        raise SystemExit(1)
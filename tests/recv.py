@@ -0,0 +1,61 @@
+from net.async import tcp
+from net.async.multiplexer import Multiplexer
+import socket
+import threading
+
+SIZE = 1000000
+
+def stream(address):
+    sock = socket.create_connection(address)
+    sock.sendall('x' * SIZE)
+    sock.close()
+
+def receive(retain):
+    '''
+    Stream SIZE bytes into a connection that only looks at what its recv
+    hook gets, or that retains it all and reads once the peer is done.
+    '''
+    async = Multiplexer()
+    server = tcp.Server(('127.0.0.1', 0), async=async)
+    result = {'hooked': 0, 'read': 0, 'paused': 0}
+
+    def recv(conn, chunk):
+        result['hooked'] += len(chunk)
+
+    def close(conn):
+        result['read'] += len(conn.read())
+        async.stop()
+
+    def pause(conn, queue):
+        result['paused'] += 1
+        # Retained data waits for us, take it so the peer can go on
+        async.queue(lambda: result.update(read=result['read']
+            + len(conn.read())))
+
+    def accept(conn):
+        conn.retain = retain
+        conn.hook('recv', recv)
+        conn.hook('pause', pause)
+        conn.hook('close', close)
+    server.hook('accept', accept)
+
+    thread = threading.Thread(target=stream, args=(server.address,))
+    thread.start()
+    async.later(10, async.stop)
+    async.run()
+    thread.join()
+    server.close()
+    return result
+
+if __name__ == '__main__':
+    # Chunks handed to the hooks are consumed, nothing piles up
+    consumed = receive(False)
+    ok = consumed == {'hooked': SIZE, 'read': 0, 'paused': 0}
+    print 'consumed', consumed, ok
+
+    retained = receive(True)
+    ok = ok and retained['hooked'] == SIZE and retained['read'] == SIZE \
+        and retained['paused'] > 0
+    print 'retained', retained, ok
+    if not ok:
+        raise SystemExit(1)
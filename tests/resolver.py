@@ -0,0 +1,122 @@
+from net.async import tcp
+from net.async.multiplexer import Multiplexer
+from net.async.resolver import Resolver, interleave
+import socket
+import time
+
+V4 = socket.AF_INET
+V6 = socket.AF_INET6
+
+def ordering():
+    addresses = [(V6, ('::1', 1)), (V6, ('::2', 1)), (V6, ('::3', 1)),
+        (V4, ('10.0.0.1', 1)), (V4, ('10.0.0.2', 1))]
+    wanted = [(V6, ('::1', 1)), (V4, ('10.0.0.1', 1)), (V6, ('::2', 1)),
+        (V4, ('10.0.0.2', 1)), (V6, ('::3', 1))]
+    print 'happy eyeballs order', interleave(addresses) == wanted
+    return interleave(addresses) == wanted
+
+class Stub(object):
+    '''
+    Slow getaddrinfo that only knows a few names.
+    '''
+    def __init__(self, hosts, delay=0.2):
+        self.hosts = hosts
+        self.delay = delay
+        self.calls = 0
+
+    def __call__(self, host, port, family=0, type=0):
+        self.calls += 1
+        time.sleep(self.delay)
+        if not host in self.hosts:
+            raise socket.gaierror(socket.EAI_NONAME, 'unknown host')
+        return [(family, type, 6, '', (address, port))
+            for family, address in self.hosts[host]]
+
+def cache():
+    stub = Stub({'stub.test': [(V4, '192.0.2.1')]})
+    resolver = Resolver(getaddrinfo=stub)
+    resolver.ttl = 0.5
+    async = Multiplexer()
+    answers = []
+    ticks = [0]
+
+    def tick():
+        # The loop keeps turning while lookups run
+        ticks[0] += 1
+        if async.running:
+            async.queue(tick)
+
+    def answer(addresses, error):
+        answers.append((addresses, error))
+        if len(answers) == 3:
+            async.stop()
+
+    resolver.resolve(async, 'stub.test', 80, answer)
+    resolver.resolve(async, 'stub.test', 80, answer)
+    resolver.resolve(async, 'unknown.test', 80, answer)
+    async.queue(tick)
+    async.run()
+    # Both lookups run at once, the failure may come in first
+    found = [item for item in answers if item[1] is None]
+    failed = [item for item in answers if item[1] is not None]
+    ok = stub.calls == 2 and ticks[0] > 10 and len(failed) == 1 \
+        and found == [([(V4, ('192.0.2.1', 80))], None)] * 2
+    print 'shared lookups', stub.calls, 'ticks', ticks[0], ok
+
+    # Answered from the cache right away, also for failures
+    resolver.resolve(async, 'stub.test', 80, answer)
+    resolver.resolve(async, 'unknown.test', 80, answer)
+    hits = len(answers) == 5 and stub.calls == 2
+    print 'cache hits', resolver.stats(), hits
+
+    # Until the entry expires
+    time.sleep(0.6)
+    resolver.resolve(async, 'stub.test', 80,
+        lambda addresses, error: async.stop())
+    async.run()
+    expired = stub.calls == 3
+    print 'expired', expired
+    return ok and hits and expired
+
+def connect(resolver, host):
+    '''
+    Connect a tcp.Client by name to a server on 127.0.0.1.
+    '''
+    async = Multiplexer()
+    server = tcp.Server(('127.0.0.1', 0), async=async)
+    server.hook('accept', lambda conn: conn.hook('recv',
+        lambda conn, chunk: conn.send(conn.read())))
+    result = []
+
+    def connected(conn):
+        conn.send('ping')
+
+    def recv(conn, chunk):
+        result.append(conn.read())
+        async.stop()
+
+    def failed(conn, error):
+        result.append(error)
+        async.stop()
+
+    client = tcp.Client((host, server.address[1]), async=async)
+    client.resolver = resolver
+    client.hook('recv', recv)
+    client.hook('error', failed)
+    client.connect(callback=connected)
+    async.run()
+    print 'connect', host, result
+    client.close()
+    server.close()
+    return result == ['ping']
+
+def tests():
+    # The first address does not answer, the second one does
+    stub = Stub({'dual.test': [(V6, '::1'), (V4, '127.0.0.1')]}, delay=0)
+    return ordering() and cache() \
+        and connect(Resolver(), 'localhost') \
+        and connect(Resolver(getaddrinfo=stub), 'dual.test')
+
+if __name__ == '__main__':
+    if not tests():
+        raise SystemExit(1)